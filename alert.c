@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <dlfcn.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "alert.h"
+#include "danger.h"
+#include "event.h"
+#include "main.h"
+
+#ifndef NO_FULLSCREEN
+/* the X11 code lives in a module, so only hosts that show the alert load X */
+static void *module = NULL;
+static int (*fullscreen_prepare)() = NULL;
+static int (*fullscreen_open)() = NULL;
+static void (*fullscreen_update)(const char *text) = NULL;
+static int (*fullscreen_dispatch)() = NULL;
+static void (*fullscreen_hide)() = NULL;
+static void (*fullscreen_close)() = NULL;
+static bool failed = false;
+
+/* X connection of the shown alert, watched by the event loop */
+static int alert_fd = -1;
+static bool prepared = false;
+
+static double now_ms()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool alert_preload()
+{
+  char *path;
+
+  if (module || failed)
+    return module != NULL;
+
+  path = getenv(PROGUPPER "_FULLSCREEN_MODULE");
+  if (path == NULL || path[0] == '\0')
+    path = FULLSCREEN_MODULE;
+
+  module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (module == NULL) {
+    warnx("Fullscreen alert unavailable: %s", dlerror());
+    failed = true;
+    return false;
+  }
+
+  *(void **)&fullscreen_prepare = dlsym(module, "fullscreen_prepare");
+  *(void **)&fullscreen_open = dlsym(module, "fullscreen_open");
+  *(void **)&fullscreen_update = dlsym(module, "fullscreen_update");
+  *(void **)&fullscreen_dispatch = dlsym(module, "fullscreen_dispatch");
+  *(void **)&fullscreen_hide = dlsym(module, "fullscreen_hide");
+  *(void **)&fullscreen_close = dlsym(module, "fullscreen_close");
+  if (!fullscreen_prepare || !fullscreen_open || !fullscreen_update
+      || !fullscreen_dispatch || !fullscreen_hide || !fullscreen_close) {
+    warnx("Fullscreen alert unavailable: %s", dlerror());
+    dlclose(module);
+    module = NULL;
+    failed = true;
+    return false;
+  }
+  return true;
+}
+
+static void alert_event(int fd, short revents, void *data)
+{
+  if (revents & (POLLHUP | POLLERR))
+    alert_close(); /* the display went away */
+  else if (fullscreen_dispatch())
+    alert_hide();
+}
+
+void alert_prepare()
+{
+  double start;
+
+  if (prepared || !alert_preload())
+    return;
+
+  /* build the window and render the message ahead of danger */
+  start = now_ms();
+  if (fullscreen_prepare() < 0)
+    return;
+  prepared = true;
+  printf("Fullscreen alert prepared in %.1f ms\n", now_ms() - start);
+  fflush(stdout);
+}
+
+void alert_show()
+{
+  double start;
+  bool cold;
+
+  if (alert_fd >= 0 || !alert_preload())
+    return;
+
+  start = now_ms();
+  cold = !prepared;
+  alert_fd = fullscreen_open();
+  if (alert_fd < 0)
+    return;
+  prepared = true;
+  event_add(alert_fd, POLLIN, alert_event, NULL);
+  printf("Fullscreen alert shown in %.1f ms%s\n", now_ms() - start, cold ? " (not prepared)" : "");
+  fflush(stdout);
+
+  /* events may already be queued while the window was mapped */
+  if (fullscreen_dispatch())
+    alert_hide();
+}
+
+/* the module redraws only when this text changes, so the values shown are
+ * rounded to what can change between two checks */
+void alert_update(BatteryState *battery)
+{
+  char status[ALERT_STATUS_LENGTH];
+  size_t length;
+  char *pending;
+  time_t when;
+  struct tm local;
+
+  if (module == NULL)
+    return;
+
+  length = snprintf(status, sizeof(status), "%d%%", battery->level);
+  if (battery->time_to_empty >= 0 && length < sizeof(status))
+    length += snprintf(status + length, sizeof(status) - length,
+        " - %d min left", (battery->time_to_empty + 59) / 60);
+
+  /* a clock time stays correct between checks, a countdown would not */
+  pending = danger_pending(&when);
+  if (pending && localtime_r(&when, &local) && length < sizeof(status))
+    snprintf(status + length, sizeof(status) - length,
+        " - %s at %02d:%02d", pending, local.tm_hour, local.tm_min);
+
+  fullscreen_update(status);
+}
+
+void alert_hide()
+{
+  if (alert_fd < 0)
+    return;
+
+  event_remove(alert_fd);
+  fullscreen_hide();
+  alert_fd = -1;
+}
+
+void alert_close()
+{
+  if (!prepared)
+    return;
+
+  alert_hide();
+  fullscreen_close();
+  prepared = false;
+}
+#else
+void alert_prepare()
+{
+}
+
+void alert_show()
+{
+}
+
+void alert_update(BatteryState *battery)
+{
+}
+
+void alert_hide()
+{
+}
+
+void alert_close()
+{
+}
+#endif
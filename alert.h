@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef ALERT_H
+#define ALERT_H
+
+#include "battery.h"
+
+/* where make install puts the fullscreen alert module */
+#ifndef FULLSCREEN_MODULE
+#define FULLSCREEN_MODULE "/usr/local/lib/batsignal/batsignal-fullscreen.so"
+#endif
+
+/* longest status line shown under the alert message */
+#define ALERT_STATUS_LENGTH 128
+
+void alert_prepare();
+void alert_show();
+void alert_update(BatteryState *battery);
+void alert_hide();
+void alert_close();
+
+#endif
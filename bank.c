@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bank.h"
+#include "battery.h"
+#include "notify.h"
+#include "template.h"
+
+/* percentage points from the bank level that make a battery an outlier,
+ * 0 when bank mode is off */
+static int bank_spread = 0;
+static int bank_count = 0;
+
+/* per battery, contiguous so the loops below vectorize */
+static int32_t *levels = NULL;
+static int8_t *outlier = NULL;
+static int8_t *candidate = NULL;
+static Template **messages = NULL;
+
+void bank_init(int spread, int count)
+{
+
+  for (int i = 0; messages && i < bank_count; i++)
+    template_free(messages[i]);
+  free(levels);
+  free(outlier);
+  free(candidate);
+  free(messages);
+  levels = NULL;
+  outlier = candidate = NULL;
+  messages = NULL;
+
+  bank_spread = spread;
+  bank_count = spread ? count : 0;
+  if (bank_count == 0)
+    return;
+
+  levels = calloc(count, sizeof(int32_t));
+  outlier = calloc(count, sizeof(int8_t));
+  candidate = calloc(count, sizeof(int8_t));
+  messages = calloc(count, sizeof(Template *));
+  if (levels == NULL || outlier == NULL || candidate == NULL || messages == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+}
+
+static int64_t sum(const int *restrict values, int count)
+{
+  int64_t total = 0;
+
+  for (int i = 0; i < count; i++)
+    total += values[i];
+  return total;
+}
+
+/* masks instead of branches so the loop vectorizes, a battery without
+ * a full value is at 0 */
+static void scale_levels(const int *restrict now, const int *restrict full,
+    int32_t *restrict out, int count)
+{
+  for (int i = 0; i < count; i++) {
+    int32_t mask = -(int32_t)(full[i] > 0);
+    float numerator = now[i] & mask;
+    float divisor = (full[i] & mask) | (~mask & 1);
+    out[i] = 100.0f * BANK_SCALE * numerator / divisor + 0.5f;
+  }
+}
+
+static void min_max(const int32_t *restrict values, int count, int *min, int *max)
+{
+  int32_t low = INT32_MAX;
+  int32_t high = INT32_MIN;
+
+  for (int i = 0; i < count; i++) {
+    low = values[i] < low ? values[i] : low;
+    high = values[i] > high ? values[i] : high;
+  }
+  *min = low;
+  *max = high;
+}
+
+/* an outlier stays one until it is back within half the spread */
+static int find_outliers(const int32_t *restrict values, const int8_t *restrict previous,
+    int8_t *restrict out, int count, int32_t center, int32_t limit)
+{
+  int total = 0;
+
+  for (int i = 0; i < count; i++) {
+    int32_t deviation = values[i] - center;
+    int32_t distance = deviation < 0 ? -deviation : deviation;
+    out[i] = distance > (previous[i] ? limit / 2 : limit);
+    total += out[i];
+  }
+  return total;
+}
+
+static int find(const int32_t *values, int count, int32_t value)
+{
+  for (int i = 0; i < count; i++)
+    if (values[i] == value)
+      return i;
+  return 0;
+}
+
+void bank_reduce(BatteryState *battery, BankStats *stats)
+{
+  stats->energy_now = sum(battery->energies_now, battery->count);
+  stats->energy_full = sum(battery->energies_full, battery->count);
+  stats->level = stats->energy_full ? 100 * BANK_SCALE * stats->energy_now / stats->energy_full : 0;
+
+  scale_levels(battery->energies_now, battery->energies_full, levels, battery->count);
+  min_max(levels, battery->count, &stats->min_level, &stats->max_level);
+  stats->imbalance = stats->max_level - stats->min_level;
+  stats->min_index = find(levels, battery->count, stats->min_level);
+  stats->max_index = find(levels, battery->count, stats->max_level);
+  stats->outliers = find_outliers(levels, outlier, candidate, battery->count,
+      stats->level, bank_spread * BANK_SCALE);
+}
+
+static void alert(BatteryState *battery, int index)
+{
+  if (messages[index] == NULL)
+    messages[index] = template_battery(BANK_MESSAGE, index);
+  notify(messages[index], NOTIFY_URGENCY_NORMAL, *battery);
+}
+
+/* alert once per battery that drifts away from the rest of the bank */
+void bank_update(BatteryState *battery)
+{
+  BankStats stats;
+  int8_t *swap;
+
+  if (bank_count == 0 || bank_count != battery->count)
+    return;
+
+  bank_reduce(battery, &stats);
+
+  for (int i = 0; i < battery->count; i++) {
+    if (candidate[i] == outlier[i])
+      continue;
+    printf("Battery %s %s at %d.%d%%, bank %d.%d%% (min %d.%d%% %s, max %d.%d%% %s)\n",
+        battery->names[i], candidate[i] ? "is an outlier" : "is back in range",
+        levels[i] / BANK_SCALE, levels[i] % BANK_SCALE,
+        stats.level / BANK_SCALE, stats.level % BANK_SCALE,
+        stats.min_level / BANK_SCALE, stats.min_level % BANK_SCALE, battery->names[stats.min_index],
+        stats.max_level / BANK_SCALE, stats.max_level % BANK_SCALE, battery->names[stats.max_index]);
+    if (candidate[i])
+      alert(battery, i);
+  }
+  fflush(stdout);
+
+  swap = outlier;
+  outlier = candidate;
+  candidate = swap;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef BANK_H
+#define BANK_H
+
+#include <stdint.h>
+#include "battery.h"
+
+/* levels are kept in tenths of a percent */
+#define BANK_SCALE 10
+
+/* sent once a battery drifts away from the bank, about that battery */
+#define BANK_MESSAGE "Battery {name} is at {level}%, away from the bank"
+
+/* reductions over every battery of the bank */
+typedef struct BankStats {
+  int64_t energy_now;
+  int64_t energy_full;
+  int level;     /* of the whole bank, in tenths of a percent */
+  int min_level;
+  int max_level;
+  int min_index;
+  int max_index;
+  int imbalance; /* max_level - min_level */
+  int outliers;
+} BankStats;
+
+void bank_init(int spread, int count);
+void bank_reduce(BatteryState *battery, BankStats *stats);
+void bank_update(BatteryState *battery);
+
+#endif
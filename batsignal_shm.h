@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Reader interface for the batsignal shared state page.
+ *
+ * batsignal -s publishes its latest battery sample in
+ * $XDG_RUNTIME_DIR/batsignal.shm. Map it once with batsignal_shm_open() and
+ * take consistent snapshots with batsignal_shm_read(); reading needs no
+ * system calls and never touches the battery firmware.
+ *
+ * The header builds as C99 or later and as C++ with GCC or Clang, whose
+ * __atomic builtins order the reads of the sequence counter.
+ */
+
+#ifndef BATSIGNAL_SHM_H
+#define BATSIGNAL_SHM_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BATSIGNAL_SHM_FILE "batsignal.shm"
+#define BATSIGNAL_SHM_MAGIC 0x53544142 /* "BATS" */
+#define BATSIGNAL_SHM_VERSION 1
+
+#define BATSIGNAL_SHM_BATTERIES 32
+#define BATSIGNAL_SHM_NAME_LENGTH 16
+
+/* aggregate states, same values as batsignal uses internally */
+#define BATSIGNAL_STATE_AC 0
+#define BATSIGNAL_STATE_DISCHARGING 1
+#define BATSIGNAL_STATE_WARNING 2
+#define BATSIGNAL_STATE_CRITICAL 3
+#define BATSIGNAL_STATE_DANGER 4
+#define BATSIGNAL_STATE_FULL 5
+
+/* per battery status */
+#define BATSIGNAL_STATUS_UNKNOWN 0
+#define BATSIGNAL_STATUS_CHARGING 1
+#define BATSIGNAL_STATUS_DISCHARGING 2
+#define BATSIGNAL_STATUS_NOT_CHARGING 3
+#define BATSIGNAL_STATUS_FULL 4
+
+struct batsignal_battery {
+  char name[BATSIGNAL_SHM_NAME_LENGTH];
+  int32_t energy_now;
+  int32_t energy_full;
+  int32_t level;
+  int32_t status;
+};
+
+struct batsignal_state {
+  int64_t updated;        /* CLOCK_REALTIME seconds of the sample */
+  int64_t energy_now;
+  int64_t energy_full;
+  double rate;            /* energy per second while discharging */
+  int32_t time_to_empty;  /* seconds, -1 if unknown */
+  int32_t level;
+  int32_t state;
+  int32_t discharging;
+  int32_t battery_count;
+  int32_t reserved;
+  struct batsignal_battery batteries[BATSIGNAL_SHM_BATTERIES];
+};
+
+struct batsignal_shm {
+  uint32_t magic;
+  uint32_t version;
+  volatile uint32_t sequence; /* odd while an update is in progress */
+  int32_t pid;
+  struct batsignal_state state;
+};
+
+/* map the page published in XDG_RUNTIME_DIR, or at path if not NULL */
+static inline const struct batsignal_shm* batsignal_shm_open(const char *path)
+{
+  char buf[4096];
+  const char *runtime_dir;
+  struct batsignal_shm *shm;
+  int fd;
+
+  if (path == NULL) {
+    runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir == NULL)
+      return NULL;
+    snprintf(buf, sizeof(buf), "%s/" BATSIGNAL_SHM_FILE, runtime_dir);
+    path = buf;
+  }
+
+#ifdef O_CLOEXEC
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+#else
+  /* strict C modes hide O_CLOEXEC, the descriptor is closed right away */
+  fd = open(path, O_RDONLY);
+#endif
+  if (fd < 0)
+    return NULL;
+  shm = (struct batsignal_shm *)mmap(NULL, sizeof(struct batsignal_shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return NULL;
+  if (shm->magic != BATSIGNAL_SHM_MAGIC || shm->version != BATSIGNAL_SHM_VERSION) {
+    munmap(shm, sizeof(struct batsignal_shm));
+    return NULL;
+  }
+  return shm;
+}
+
+/* copy a consistent snapshot, returns 0 on success, -1 if nothing was published yet */
+static inline int batsignal_shm_read(const struct batsignal_shm *shm, struct batsignal_state *state)
+{
+  uint32_t before;
+  uint32_t after;
+
+  do {
+    before = __atomic_load_n(&shm->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1)
+      continue;
+    memcpy(state, &shm->state, sizeof(*state));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&shm->sequence, __ATOMIC_RELAXED);
+  } while ((before & 1) || before != after);
+
+  return before == 0 ? -1 : 0;
+}
+
+static inline void batsignal_shm_close(const struct batsignal_shm *shm)
+{
+  munmap((void *)shm, sizeof(struct batsignal_shm));
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "main.h"
+#include "server.h"
+
+void print_help()
+{
+  printf("Usage: %sctl [OPTIONS]\n\
+\n\
+Queries a running %s daemon started with -L.\n\
+\n\
+Options:\n\
+    -h             print this help message\n\
+    -f             follow state changes until interrupted\n\
+    -S SOCKET      connect to SOCKET\n\
+                   (default: $XDG_RUNTIME_DIR/%s)\n\
+", PROGNAME, PROGNAME, SERVER_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  char *socket_path = NULL;
+  char *runtime_dir;
+  char *command = "query\n";
+  char buf[SERVER_MESSAGE_LENGTH];
+  ssize_t received;
+  int fd;
+  int c;
+
+  while ((c = getopt(argc, argv, ":hfS:")) != -1) {
+    switch (c) {
+      case 'h':
+        print_help();
+        return EXIT_SUCCESS;
+      case 'f':
+        command = "subscribe\n";
+        break;
+      case 'S':
+        socket_path = optarg;
+        break;
+      case '?':
+        errx(EXIT_FAILURE, "Unknown option `-%c'.", optopt);
+      case ':':
+        errx(EXIT_FAILURE, "Option -%c requires an argument.", optopt);
+    }
+  }
+
+  if (socket_path) {
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+  } else {
+    runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir == NULL || runtime_dir[0] == '\0')
+      errx(EXIT_FAILURE, "XDG_RUNTIME_DIR is not set");
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s/" SERVER_SOCKET, runtime_dir);
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    err(EXIT_FAILURE, "Could not create socket");
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    err(EXIT_FAILURE, "Could not connect to %s", address.sun_path);
+  if (write(fd, command, strlen(command)) < 0)
+    err(EXIT_FAILURE, "Could not send request");
+
+  /* status bars read line by line, don't hold anything back */
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  while ((received = read(fd, buf, sizeof(buf))) > 0)
+    fwrite(buf, 1, received, stdout);
+
+  close(fd);
+  return EXIT_SUCCESS;
+}
@@ -6,23 +6,67 @@
 #include <dirent.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "battery.h"
+#include "metrics.h"
+
+static char *state_names[] = {
+  "ac", "discharging", "warning", "critical", "danger", "full"
+};
+
+static char *status_names[] = {
+  "unknown", "charging", "discharging", "not-charging", "full"
+};
 
 static char *attr_path = NULL;
+static char *supply_path = NULL;
+static char *now_attr = NULL;
+static char *full_attr = NULL;
+
+/* batteries reported changed since the last check */
+static int *changed = NULL;
+static bool *changed_flags = NULL;
+static int changed_count = 0;
+
+char* state_name(char state)
+{
+  return state_names[(int)state];
+}
+
+char* status_name(char status)
+{
+  return status_names[(int)status];
+}
+
+int battery_level(BatteryState *battery, int index)
+{
+  if (battery->energies_full[index] == 0)
+    return 0;
+  return round(100.0 * battery->energies_now[index] / battery->energies_full[index]);
+}
+
+void set_battery_root(char *root)
+{
+  supply_path = realloc(supply_path, strlen(root) + strlen(POWER_SUPPLY_SUBSYSTEM) + 1);
+  if (supply_path == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  strcpy(supply_path, root);
+  strcat(supply_path, POWER_SUPPLY_SUBSYSTEM);
+}
 
 static void set_attributes(char *battery_name, char **now_attribute, char **full_attribute)
 {
-  sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/charge_now", battery_name);
+  sprintf(attr_path, "%s/%s/charge_now", supply_path, battery_name);
   if (access(attr_path, F_OK) == 0) {
     *now_attribute = "charge_now";
     *full_attribute = "charge_full";
   } else {
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/energy_now", battery_name);
+    sprintf(attr_path, "%s/%s/energy_now", supply_path, battery_name);
     if (access(attr_path, F_OK) == 0) {
       *now_attribute = "energy_now";
       *full_attribute = "energy_full";
@@ -33,12 +77,25 @@ static void set_attributes(char *battery_name, char **now_attribute, char **full
   }
 }
 
+static char parse_status(char *status)
+{
+  if (strcmp(status, POWER_SUPPLY_DISCHARGING) == 0)
+    return STATUS_DISCHARGING;
+  if (strcmp(status, POWER_SUPPLY_CHARGING) == 0)
+    return STATUS_CHARGING;
+  if (strcmp(status, POWER_SUPPLY_FULL) == 0)
+    return STATUS_FULL;
+  if (strcmp(status, POWER_SUPPLY_NOT_CHARGING) == 0)
+    return STATUS_NOT_CHARGING;
+  return STATUS_UNKNOWN;
+}
+
 static bool is_type_battery(char *name)
 {
   FILE *file;
   char type[11] = "";
 
-  sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/type", name);
+  sprintf(attr_path, "%s/%s/type", supply_path, name);
   file = fopen(attr_path, "r");
   if (file != NULL) {
     if (fscanf(file, "%10s", type) == 0) { /* Continue... */ }
@@ -57,7 +114,7 @@ static bool has_capacity_field(char *name)
   set_attributes(name, &now_attribute, &full_attribute);
 
   if (strcmp(now_attribute, "capacity") == 0) {
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/capacity", name);
+    sprintf(attr_path, "%s/%s/capacity", supply_path, name);
     file = fopen(attr_path, "r");
     if (file != NULL) {
       if (fscanf(file, "%d", &capacity) == 0) { /* Continue... */ }
@@ -76,7 +133,7 @@ static bool is_battery(char *name)
 
 int find_batteries(char ***battery_names)
 {
-  unsigned int path_len = strlen(POWER_SUPPLY_SUBSYSTEM) + POWER_SUPPLY_ATTR_LENGTH;
+  unsigned int path_len = strlen(supply_path) + POWER_SUPPLY_ATTR_LENGTH;
   unsigned int entry_name_len = 5;
   int battery_count = 0;
   DIR *dir;
@@ -84,7 +141,7 @@ int find_batteries(char ***battery_names)
 
   attr_path = realloc(attr_path, path_len + entry_name_len);
 
-  dir = opendir(POWER_SUPPLY_SUBSYSTEM);
+  dir = opendir(supply_path);
   if (dir) {
     while ((entry = readdir(dir)) != NULL) {
       if (strlen(entry->d_name) > entry_name_len) {
@@ -112,7 +169,7 @@ int find_batteries(char ***battery_names)
 
 int validate_batteries(char **battery_names, int battery_count)
 {
-  unsigned int path_len = strlen(POWER_SUPPLY_SUBSYSTEM) + POWER_SUPPLY_ATTR_LENGTH;
+  unsigned int path_len = strlen(supply_path) + POWER_SUPPLY_ATTR_LENGTH;
   unsigned int name_len = 5;
   int return_value = -1;
 
@@ -132,67 +189,206 @@ int validate_batteries(char **battery_names, int battery_count)
   return return_value;
 }
 
+/* a battery's directory, opened once so that checks format no paths */
+static int open_battery(BatteryState *battery, int index)
+{
+  if (battery->dirs[index] < 0) {
+    sprintf(attr_path, "%s/%s", supply_path, battery->names[index]);
+    battery->dirs[index] = open(attr_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+  return battery->dirs[index];
+}
+
+/* the first line of an attribute, or false if it could not be read */
+static bool read_attribute(int dir, char *name, char *buffer, size_t size)
+{
+  ssize_t length;
+  int fd;
+
+  if (dir < 0 || (fd = openat(dir, name, O_RDONLY | O_CLOEXEC)) < 0)
+    return false;
+  length = read(fd, buffer, size - 1);
+  close(fd);
+  if (length <= 0)
+    return false;
+  buffer[length] = '\0';
+  buffer[strcspn(buffer, " \n")] = '\0';
+  return buffer[0] != '\0';
+}
+
+/* a removed battery may come back as a new directory, so it is reopened */
+static void read_failed(BatteryState *battery, int index, char *name, bool required)
+{
+  metrics_count(COUNTER_READ_ERRORS);
+  if (battery->dirs[index] >= 0) {
+    close(battery->dirs[index]);
+    battery->dirs[index] = -1;
+  }
+  if (required) {
+    sprintf(attr_path, "%s/%s/%s", supply_path, battery->names[index], name);
+    err(EXIT_FAILURE, "Could not read %s", attr_path);
+  }
+}
+
+static void allocate(BatteryState *battery)
+{
+  set_attributes(battery->names[0], &now_attr, &full_attr);
+  battery->energies_now = calloc(battery->count, sizeof(int));
+  battery->energies_full = calloc(battery->count, sizeof(int));
+  battery->statuses = calloc(battery->count, sizeof(char));
+  battery->dirs = malloc(battery->count * sizeof(int));
+  battery->counted = calloc(battery->count, sizeof(char));
+  if (battery->energies_now == NULL || battery->energies_full == NULL
+      || battery->statuses == NULL || battery->dirs == NULL || battery->counted == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  for (int i = 0; i < battery->count; i++)
+    battery->dirs[i] = -1;
+}
+
+/* read one battery into its slot, a failed read leaves it empty */
+static void read_battery(BatteryState *battery, int i, bool required)
+{
+  char value[24];
+  int dir;
+  int tmp_now;
+  int tmp_full;
+  double start;
+
+  battery->energies_now[i] = 0;
+  battery->energies_full[i] = 0;
+  battery->statuses[i] = STATUS_UNKNOWN;
+  battery->counted[i] = STATUS_UNREADABLE;
+  dir = open_battery(battery, i);
+
+  start = metrics_start();
+  if (!read_attribute(dir, "status", value, sizeof(value))) {
+    read_failed(battery, i, "status", required);
+    return;
+  }
+  metrics_observe(METRIC_READ_STATUS, start);
+  battery->statuses[i] = parse_status(value);
+  battery->counted[i] = battery->statuses[i];
+
+  start = metrics_start();
+  if (!read_attribute(dir, now_attr, value, sizeof(value))) {
+    read_failed(battery, i, now_attr, required);
+    return;
+  }
+  tmp_now = strtoul(value, NULL, 10);
+  metrics_observe(METRIC_READ_NOW, start);
+
+  if (full_attr != NULL) {
+    start = metrics_start();
+    if (!read_attribute(dir, full_attr, value, sizeof(value))) {
+      read_failed(battery, i, full_attr, required);
+      return;
+    }
+    tmp_full = strtoul(value, NULL, 10);
+    metrics_observe(METRIC_READ_FULL, start);
+  } else {
+    tmp_full = 100;
+  }
+
+  battery->energies_now[i] = tmp_now;
+  battery->energies_full[i] = tmp_full;
+}
+
+/* a battery whose status could not be read is left out, so it does not
+ * keep the others from being full; one that reads any status other than
+ * full, unknown included, is not full */
+static void summarize(BatteryState *battery)
+{
+  battery->discharging = battery->status_counts[STATUS_DISCHARGING] > 0;
+  battery->full = battery->status_counts[STATUS_FULL]
+    == battery->count - battery->status_counts[STATUS_UNREADABLE];
+  battery->level = battery->energy_full ? round(100.0 * battery->energy_now / battery->energy_full) : 0;
+}
+
+/* read every battery and total them from scratch, which also verifies the
+ * totals kept by update_changed_batteries() */
 void update_battery_state(BatteryState *battery, bool required)
 {
-  char state[15];
-  char *now_attribute;
-  char *full_attribute;
-  unsigned int tmp_now;
-  unsigned int tmp_full;
-  FILE *file;
+  int previous_now;
+  int previous_full;
+  char previous_status;
+
+  if (battery->statuses == NULL)
+    allocate(battery);
 
-  battery->discharging = false;
-  battery->full = true;
   battery->energy_now = 0;
   battery->energy_full = 0;
-  set_attributes(battery->names[0], &now_attribute, &full_attribute);
+  memset(battery->status_counts, 0, sizeof(battery->status_counts));
 
   /* iterate through all batteries */
   for (int i = 0; i < battery->count; i++) {
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/status", battery->names[i]);
-    file = fopen(attr_path, "r");
-    if (file == NULL || fscanf(file, "%12s", state) == 0) {
-      if (required)
-        err(EXIT_FAILURE, "Could not read %s", attr_path);
-      battery->discharging |= 0;
-      if (file)
-        fclose(file);
-      continue;
-    }
-    fclose(file);
+    previous_now = battery->energies_now[i];
+    previous_full = battery->energies_full[i];
+    previous_status = battery->statuses[i];
 
-    battery->discharging |= strcmp(state, POWER_SUPPLY_DISCHARGING) == 0;
-    battery->full &= strcmp(state, POWER_SUPPLY_FULL) == 0;
+    read_battery(battery, i, required);
 
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/%s", battery->names[i], now_attribute);
-    file = fopen(attr_path, "r");
-    if (file == NULL || fscanf(file, "%u", &tmp_now) == 0) {
-      if (required)
-        err(EXIT_FAILURE, "Could not read %s", attr_path);
-      if (file)
-        fclose(file);
-      continue;
-    }
-    fclose(file);
+    /* a change nobody announced means uevents cannot be relied on alone */
+    if (changed_flags && !changed_flags[i] && (previous_now != battery->energies_now[i]
+          || previous_full != battery->energies_full[i] || previous_status != battery->statuses[i]))
+      metrics_count(COUNTER_UEVENT_MISSED);
 
-    if (full_attribute != NULL) {
-      sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/%s", battery->names[i], full_attribute);
-      file = fopen(attr_path, "r");
-      if (file == NULL || fscanf(file, "%u", &tmp_full) == 0) {
-        if (required)
-          err(EXIT_FAILURE, "Could not read %s", attr_path);
-        if (file)
-          fclose(file);
-        continue;
-      }
-      fclose(file);
-    } else {
-      tmp_full = 100;
-    }
+    battery->energy_now += battery->energies_now[i];
+    battery->energy_full += battery->energies_full[i];
+    battery->status_counts[(int)battery->counted[i]]++;
+  }
 
-    battery->energy_now += tmp_now;
-    battery->energy_full += tmp_full;
+  if (changed_flags) {
+    for (int i = 0; i < changed_count; i++)
+      changed_flags[changed[i]] = false;
+    changed_count = 0;
   }
+  summarize(battery);
+}
+
+/* start remembering which batteries are reported changed */
+void track_battery_changes(BatteryState *battery)
+{
+  if (changed_flags)
+    return;
+  changed = malloc(battery->count * sizeof(int));
+  changed_flags = calloc(battery->count, sizeof(bool));
+  if (changed == NULL || changed_flags == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+}
+
+void battery_changed(int index)
+{
+  if (changed_flags == NULL || changed_flags[index])
+    return;
+  changed_flags[index] = true;
+  changed[changed_count++] = index;
+}
+
+bool battery_changes_pending()
+{
+  return changed_count > 0;
+}
+
+/* read only the batteries reported changed and apply the difference to the
+ * totals, whatever the number of batteries */
+void update_changed_batteries(BatteryState *battery, bool required)
+{
+  int i;
+
+  for (int c = 0; c < changed_count; c++) {
+    i = changed[c];
+    changed_flags[i] = false;
+
+    battery->energy_now -= battery->energies_now[i];
+    battery->energy_full -= battery->energies_full[i];
+    battery->status_counts[(int)battery->counted[i]]--;
 
-  battery->level = round(100.0 * battery->energy_now / battery->energy_full);
+    read_battery(battery, i, required);
+
+    battery->energy_now += battery->energies_now[i];
+    battery->energy_full += battery->energies_full[i];
+    battery->status_counts[(int)battery->counted[i]]++;
+  }
+  changed_count = 0;
+  summarize(battery);
 }
@@ -6,6 +6,7 @@
 #define BATTERY_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /* battery states */
 #define STATE_AC 0
@@ -15,12 +16,28 @@
 #define STATE_DANGER 4
 #define STATE_FULL 5
 
+/* default levels, of all batteries and of each group */
+#define LEVEL_WARNING 15
+#define LEVEL_CRITICAL 5
+#define LEVEL_DANGER 2
+#define LEVEL_FULL 0
+
+/* per battery status */
+#define STATUS_UNKNOWN 0
+#define STATUS_CHARGING 1
+#define STATUS_DISCHARGING 2
+#define STATUS_NOT_CHARGING 3
+#define STATUS_FULL 4
+#define STATUS_UNREADABLE 5 /* only counted in the totals */
+
 /* system paths */
 #define POWER_SUPPLY_SUBSYSTEM "/sys/class/power_supply"
 
 /* Battery state strings */
 #define POWER_SUPPLY_FULL "Full"
 #define POWER_SUPPLY_DISCHARGING "Discharging"
+#define POWER_SUPPLY_CHARGING "Charging"
+#define POWER_SUPPLY_NOT_CHARGING "Not" /* only the first word is read */
 
 #define POWER_SUPPLY_ATTR_LENGTH 15
 
@@ -32,12 +49,32 @@ typedef struct BatteryState {
   bool full;
   char state;
   int level;
-  int energy_full;
-  int energy_now;
+  int64_t energy_full;
+  int64_t energy_now;
+  double rate; /* energy per second while discharging */
+  int time_to_empty; /* seconds, -1 if unknown */
+
+  /* per battery samples */
+  int *energies_now;
+  int *energies_full;
+  char *statuses;
+  int *dirs; /* open power_supply directories, -1 until opened */
+
+  /* batteries in each status, kept along with the energy totals */
+  char *counted; /* status each battery is counted in */
+  int status_counts[STATUS_UNREADABLE + 1];
 } BatteryState;
 
+char* state_name(char state);
+char* status_name(char status);
+void set_battery_root(char *root);
 int find_batteries(char ***battery_names);
 int validate_batteries(char **battery_names, int battery_count);
 void update_battery_state(BatteryState *battery, bool required);
+void track_battery_changes(BatteryState *battery);
+void battery_changed(int index);
+bool battery_changes_pending();
+void update_changed_batteries(BatteryState *battery, bool required);
+int battery_level(BatteryState *battery, int index);
 
 #endif
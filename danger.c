@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "battery.h"
+#include "danger.h"
+#include "logind.h"
+#include "metrics.h"
+
+static char *danger_command = NULL;
+static DangerStep *ladder = NULL;
+static int ladder_count = 0;
+
+/* index of the current step, -1 when idle, ladder_count when finished */
+static int current = -1;
+
+/* step requested once the current one runs past its deadline, the current
+ * one again after it put the machine to sleep and it woke up in danger */
+static int next_step;
+
+static double entered;
+static double step_started;
+static double step_suspended;
+
+static double clock_seconds(clockid_t clock)
+{
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* time spent suspended since boot: CLOCK_MONOTONIC stops, CLOCK_BOOTTIME doesn't */
+static double suspended_seconds()
+{
+  return clock_seconds(CLOCK_BOOTTIME) - clock_seconds(CLOCK_MONOTONIC);
+}
+
+static char* step_name(int index)
+{
+  if (ladder[index].action == DANGER_COMMAND)
+    return "command";
+  return logind_action_name(ladder[index].action);
+}
+
+static bool run_step(int index)
+{
+  double start;
+  int status;
+
+  if (ladder[index].action == DANGER_COMMAND) {
+    start = metrics_start();
+    status = system(danger_command);
+    metrics_observe(METRIC_COMMAND, start);
+    return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  return logind_run(ladder[index].action);
+}
+
+/* start steps from index onwards until one is accepted */
+static void escalate(int index)
+{
+  double before;
+  bool ok;
+
+  for (current = index; current < ladder_count; current++) {
+    before = clock_seconds(CLOCK_MONOTONIC);
+    ok = run_step(current);
+    step_started = clock_seconds(CLOCK_MONOTONIC);
+    step_suspended = suspended_seconds();
+
+    printf("Danger step %d/%d %s %s at +%.1fs (took %.0f ms)\n",
+        current + 1, ladder_count, step_name(current), ok ? "requested" : "failed",
+        before - entered, (step_started - before) * 1000);
+    fflush(stdout);
+    if (ok) {
+      next_step = current + 1;
+      return;
+    }
+  }
+  printf("Danger steps exhausted at +%.1fs\n", clock_seconds(CLOCK_MONOTONIC) - entered);
+  fflush(stdout);
+}
+
+int parse_danger_steps(char *spec, DangerStep **steps)
+{
+  int count = 0;
+  char *name;
+  char *deadline;
+  char *end;
+  long seconds;
+
+  for (name = strtok(spec, ","); name; name = strtok(NULL, ",")) {
+    *steps = realloc(*steps, sizeof(DangerStep) * (count + 1));
+    if (*steps == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+
+    (*steps)[count].deadline = DANGER_DEADLINE;
+    deadline = strchr(name, ':');
+    if (deadline) {
+      *deadline++ = '\0';
+      errno = 0;
+      seconds = strtol(deadline, &end, 10);
+      if (end == deadline || *end != '\0' || errno || seconds < 1 || seconds > DANGER_DEADLINE_MAX)
+        errx(EXIT_FAILURE, "Danger step deadline `%s' must be between 1 and %d seconds.",
+            deadline, DANGER_DEADLINE_MAX);
+      (*steps)[count].deadline = seconds;
+    }
+
+    if (strcmp(name, "command") == 0)
+      (*steps)[count].action = DANGER_COMMAND;
+    else if (((*steps)[count].action = logind_action(name)) < 0)
+      errx(EXIT_FAILURE, "Unknown danger action `%s'.", name);
+    else if ((*steps)[count].action == ACTION_NONE)
+      continue;
+    count++;
+  }
+
+  return count;
+}
+
+void danger_start(char *command, DangerStep *steps, int count, BatteryState *battery)
+{
+  bool command_step = false;
+  double start;
+
+  /* copied, a reload may free the configuration while the ladder runs */
+  free(danger_command);
+  danger_command = strdup(command);
+  ladder = realloc(ladder, sizeof(DangerStep) * (count ? count : 1));
+  if (danger_command == NULL || ladder == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  memcpy(ladder, steps, sizeof(DangerStep) * count);
+  ladder_count = count;
+  entered = clock_seconds(CLOCK_MONOTONIC);
+
+  for (int i = 0; i < count; i++)
+    command_step |= steps[i].action == DANGER_COMMAND;
+
+  /* without an explicit command step the command simply runs first */
+  if (!command_step && command[0] != '\0') {
+    start = metrics_start();
+    if (system(command) == -1) { /* Ignore command errors... */ }
+    metrics_observe(METRIC_COMMAND, start);
+  }
+
+  if (count > 0) {
+    printf("Entered danger level at %d%%\n", battery->level);
+    escalate(0);
+  }
+}
+
+int danger_update(BatteryState *battery)
+{
+  double now;
+  double remaining;
+
+  if (current < 0)
+    return 0;
+
+  now = clock_seconds(CLOCK_MONOTONIC);
+
+  if (battery->state != STATE_DANGER) {
+    printf("Left danger level at %d%% after %.1fs\n", battery->level, now - entered);
+    fflush(stdout);
+    current = -1;
+    return 0;
+  }
+
+  if (current >= ladder_count)
+    return 0;
+
+  /* waking up from a requested sleep state means the step did its job,
+   * still in danger the step gets requested again after its deadline */
+  if (suspended_seconds() - step_suspended >= 1) {
+    printf("Resume observed %.1fs after %s request, %d%% remaining\n",
+        now - step_started, step_name(current), battery->level);
+    fflush(stdout);
+    step_started = now;
+    step_suspended = suspended_seconds();
+    next_step = current;
+  }
+
+  remaining = step_started + ladder[current].deadline - now;
+  if (remaining <= 0) {
+    printf("Danger step %s not effective after %.1fs, %d%% remaining\n",
+        step_name(current), now - step_started, battery->level);
+    fflush(stdout);
+    escalate(next_step);
+    if (current >= ladder_count)
+      return 0;
+    remaining = ladder[current].deadline;
+  }
+
+  return remaining < 1 ? 1 : (int)remaining;
+}
+
+/* the step requested next if the current one has no effect, and when */
+char* danger_pending(time_t *when)
+{
+  double remaining;
+
+  if (current < 0 || current >= ladder_count || next_step >= ladder_count)
+    return NULL;
+
+  remaining = step_started + ladder[current].deadline - clock_seconds(CLOCK_MONOTONIC);
+  *when = time(NULL) + (remaining > 0 ? (time_t)remaining : 0);
+  return step_name(next_step);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef DANGER_H
+#define DANGER_H
+
+#include <time.h>
+#include "battery.h"
+
+/* step that runs the danger command (-D) instead of a logind action */
+#define DANGER_COMMAND -1
+
+/* seconds to wait for a step to take effect before escalating */
+#define DANGER_DEADLINE 60
+#define DANGER_DEADLINE_MAX 86400
+
+/* a step in the danger escalation ladder */
+typedef struct DangerStep {
+  int action;
+  int deadline;
+} DangerStep;
+
+int parse_danger_steps(char *spec, DangerStep **steps);
+void danger_start(char *command, DangerStep *steps, int count, BatteryState *battery);
+int danger_update(BatteryState *battery);
+char* danger_pending(time_t *when);
+
+#endif
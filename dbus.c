@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#ifndef NO_DBUS
+#include <gio/gio.h>
+#endif
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "battery.h"
+#include "dbus.h"
+
+#ifndef NO_DBUS
+/* property indexes, also the order of the changed property bits */
+#define PROPERTY_LEVEL 0
+#define PROPERTY_STATE 1
+#define PROPERTY_DISCHARGING 2
+#define PROPERTY_TIME_TO_EMPTY 3
+#define PROPERTY_BATTERIES 4
+#define PROPERTY_COUNT 5
+
+static const char introspection_xml[] =
+  "<node>"
+  "  <interface name='" DBUS_SERVICE_INTERFACE "'>"
+  "    <property name='Level' type='i' access='read'/>"
+  "    <property name='State' type='s' access='read'/>"
+  "    <property name='Discharging' type='b' access='read'/>"
+  "    <property name='TimeToEmpty' type='x' access='read'/>"
+  "    <property name='Batteries' type='a(sis)' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+static char *property_names[] = {
+  "Level", "State", "Discharging", "TimeToEmpty", "Batteries"
+};
+
+typedef struct Properties {
+  int level;
+  char state;
+  bool discharging;
+  gint64 time_to_empty;
+  int count;
+  char **names;
+  int *levels;
+  char *statuses;
+} Properties;
+
+/* properties are read by the bus thread and written by the main loop */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static Properties current;
+static GDBusConnection *connection = NULL;
+static GDBusNodeInfo *introspection = NULL;
+static GMainContext *context = NULL;
+
+static GVariant* property_value(int property)
+{
+  GVariantBuilder builder;
+
+  switch (property) {
+    case PROPERTY_LEVEL:
+      return g_variant_new_int32(current.level);
+    case PROPERTY_STATE:
+      return g_variant_new_string(state_name(current.state));
+    case PROPERTY_DISCHARGING:
+      return g_variant_new_boolean(current.discharging);
+    case PROPERTY_TIME_TO_EMPTY:
+      return g_variant_new_int64(current.time_to_empty);
+    default:
+      g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sis)"));
+      for (int i = 0; i < current.count; i++)
+        g_variant_builder_add(&builder, "(sis)", current.names[i], current.levels[i],
+            status_name(current.statuses[i]));
+      return g_variant_builder_end(&builder);
+  }
+}
+
+static GVariant* get_property(GDBusConnection *bus, const gchar *sender,
+    const gchar *path, const gchar *interface, const gchar *name,
+    GError **error, gpointer data)
+{
+  GVariant *value = NULL;
+
+  pthread_mutex_lock(&lock);
+  for (int i = 0; i < PROPERTY_COUNT; i++)
+    if (strcmp(name, property_names[i]) == 0)
+      value = property_value(i);
+  pthread_mutex_unlock(&lock);
+  return value;
+}
+
+static const GDBusInterfaceVTable vtable = {
+  .get_property = get_property
+};
+
+static void bus_acquired(GDBusConnection *bus, const gchar *name, gpointer data)
+{
+  GError *error = NULL;
+
+  if (g_dbus_connection_register_object(bus, DBUS_SERVICE_PATH,
+      introspection->interfaces[0], &vtable, NULL, NULL, &error) == 0) {
+    warnx("Could not register %s: %s", DBUS_SERVICE_PATH, error->message);
+    g_error_free(error);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  connection = bus;
+  pthread_mutex_unlock(&lock);
+}
+
+static void name_lost(GDBusConnection *bus, const gchar *name, gpointer data)
+{
+  warnx("Could not own D-Bus name %s", name);
+}
+
+/* the bus is served from its own thread so the main loop never waits on it */
+static void* bus_thread(void *data)
+{
+  GMainLoop *loop;
+
+  g_main_context_push_thread_default(context);
+  g_bus_own_name(G_BUS_TYPE_SESSION, DBUS_SERVICE_NAME, G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE,
+      bus_acquired, NULL, name_lost, NULL, NULL);
+  loop = g_main_loop_new(context, FALSE);
+  g_main_loop_run(loop);
+  return NULL;
+}
+
+void dbus_init(BatteryState *battery)
+{
+  pthread_t thread;
+  GError *error = NULL;
+
+  introspection = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+  if (introspection == NULL)
+    errx(EXIT_FAILURE, "Invalid D-Bus introspection data: %s", error->message);
+
+  current.count = battery->count;
+  current.names = battery->names;
+  current.levels = calloc(battery->count, sizeof(int));
+  current.statuses = calloc(battery->count, sizeof(char));
+  if (current.levels == NULL || current.statuses == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  current.time_to_empty = -1;
+
+  context = g_main_context_new();
+  if (pthread_create(&thread, NULL, bus_thread, NULL) != 0)
+    errx(EXIT_FAILURE, "Could not start D-Bus thread");
+  pthread_detach(thread);
+}
+
+void dbus_publish(BatteryState *battery)
+{
+  GVariantBuilder changed;
+  unsigned int mask = 0;
+  gint64 time_to_empty = -1;
+  int level;
+
+  /* the estimate moves every check, only whole minutes count as a change */
+  if (battery->time_to_empty >= 0)
+    time_to_empty = battery->time_to_empty / 60 * 60;
+
+  pthread_mutex_lock(&lock);
+
+  if (current.level != battery->level)
+    mask |= 1 << PROPERTY_LEVEL;
+  if (current.state != battery->state)
+    mask |= 1 << PROPERTY_STATE;
+  if (current.discharging != battery->discharging)
+    mask |= 1 << PROPERTY_DISCHARGING;
+  if (current.time_to_empty != time_to_empty)
+    mask |= 1 << PROPERTY_TIME_TO_EMPTY;
+
+  current.level = battery->level;
+  current.state = battery->state;
+  current.discharging = battery->discharging;
+  current.time_to_empty = time_to_empty;
+
+  for (int i = 0; i < current.count; i++) {
+    level = battery_level(battery, i);
+    if (current.levels[i] != level || current.statuses[i] != battery->statuses[i])
+      mask |= 1 << PROPERTY_BATTERIES;
+    current.levels[i] = level;
+    current.statuses[i] = battery->statuses[i];
+  }
+
+  /* all changes of one check go out in a single signal */
+  if (mask && connection) {
+    g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+    for (int i = 0; i < PROPERTY_COUNT; i++)
+      if (mask & (1 << i))
+        g_variant_builder_add(&changed, "{sv}", property_names[i], property_value(i));
+    g_dbus_connection_emit_signal(connection, NULL, DBUS_SERVICE_PATH,
+        "org.freedesktop.DBus.Properties", "PropertiesChanged",
+        g_variant_new("(sa{sv}as)", DBUS_SERVICE_INTERFACE, &changed, NULL), NULL);
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+#else
+void dbus_init(BatteryState *battery)
+{
+  errx(EXIT_FAILURE, "Built without D-Bus support");
+}
+
+void dbus_publish(BatteryState *battery)
+{
+}
+#endif
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef DBUS_H
+#define DBUS_H
+
+#include "battery.h"
+
+/* D-Bus names of the battery state service */
+#define DBUS_SERVICE_NAME "org.batsignal"
+#define DBUS_SERVICE_PATH "/org/batsignal"
+#define DBUS_SERVICE_INTERFACE "org.batsignal.Battery"
+
+void dbus_init(BatteryState *battery);
+void dbus_publish(BatteryState *battery);
+
+#endif
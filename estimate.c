@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+#include "battery.h"
+#include "estimate.h"
+
+typedef struct Sample {
+  double time;
+  int64_t energy;
+} Sample;
+
+static Sample samples[ESTIMATE_SAMPLES];
+static int sample_count = 0;
+static int newest = -1;
+static double previous_rate = 0;
+static int steady = 0;
+static int unsteady = 0;
+
+/* boot time keeps running while suspended, so does the battery drain */
+static double now_seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void estimate_reset()
+{
+  sample_count = 0;
+  newest = -1;
+  previous_rate = 0;
+  steady = 0;
+  unsteady = 0;
+}
+
+void estimate_update(BatteryState *battery)
+{
+  double now = now_seconds();
+  int oldest;
+
+  battery->rate = 0;
+  battery->time_to_empty = -1;
+
+  if (!battery->discharging) {
+    estimate_reset();
+    return;
+  }
+
+  newest = (newest + 1) % ESTIMATE_SAMPLES;
+  samples[newest].time = now;
+  samples[newest].energy = battery->energy_now;
+  if (sample_count < ESTIMATE_SAMPLES)
+    sample_count++;
+
+  /* drop samples that fell out of the window */
+  while (sample_count > 1) {
+    oldest = (newest - sample_count + 1 + ESTIMATE_SAMPLES) % ESTIMATE_SAMPLES;
+    if (now - samples[oldest].time <= ESTIMATE_WINDOW)
+      break;
+    sample_count--;
+  }
+  oldest = (newest - sample_count + 1 + ESTIMATE_SAMPLES) % ESTIMATE_SAMPLES;
+  if (sample_count < 2 || samples[oldest].energy <= samples[newest].energy
+      || now - samples[oldest].time < 1) {
+    steady = 0;
+    unsteady = 0;
+    return;
+  }
+
+  battery->rate = (samples[oldest].energy - samples[newest].energy) / (now - samples[oldest].time);
+  battery->time_to_empty = battery->energy_now / battery->rate;
+
+  if (previous_rate > 0 && fabs(battery->rate - previous_rate) * 100
+      <= previous_rate * ESTIMATE_STABLE_CHANGE) {
+    steady++;
+    unsteady = 0;
+  } else if (estimate_stable() && ++unsteady < ESTIMATE_STABLE_UPDATES) {
+    /* a single jump in load does not unsettle the estimate, the rate it
+     * is compared with stays the settled one */
+    return;
+  } else {
+    steady = 0;
+    unsteady = 0;
+  }
+  previous_rate = battery->rate;
+}
+
+/* whether time_to_empty is settled enough to act on */
+bool estimate_stable()
+{
+  return steady >= ESTIMATE_STABLE_UPDATES;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+/* number of samples kept for the drain rate */
+#define ESTIMATE_SAMPLES 8
+
+/* samples older than this many seconds are not used */
+#define ESTIMATE_WINDOW 1800
+
+/* the estimate is trusted once this many updates in a row changed the
+ * drain rate by at most ESTIMATE_STABLE_CHANGE percent, and stays trusted
+ * until as many updates in a row changed it by more */
+#define ESTIMATE_STABLE_UPDATES 3
+#define ESTIMATE_STABLE_CHANGE 10
+
+void estimate_update(BatteryState *battery);
+void estimate_reset();
+bool estimate_stable();
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/signalfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "event.h"
+
+typedef struct EventSource {
+  EventCallback callback;
+  void *data;
+} EventSource;
+
+/* pollfds[0] is always the signalfd */
+static struct pollfd *pollfds = NULL;
+static EventSource *sources = NULL;
+static int source_count = 0;
+static int source_capacity = 0;
+
+static int find_source(int fd)
+{
+  for (int i = 1; i < source_count; i++)
+    if (pollfds[i].fd == fd)
+      return i;
+  return -1;
+}
+
+void event_init(sigset_t *signals)
+{
+  int fd;
+
+  /* signals must already be blocked so they are only seen here */
+  fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0)
+    err(EXIT_FAILURE, "Could not create signalfd");
+  event_add(fd, POLLIN, NULL, NULL);
+}
+
+void event_add(int fd, short events, EventCallback callback, void *data)
+{
+  if (source_count == source_capacity) {
+    source_capacity = source_capacity ? source_capacity * 2 : 8;
+    pollfds = realloc(pollfds, sizeof(struct pollfd) * source_capacity);
+    sources = realloc(sources, sizeof(EventSource) * source_capacity);
+    if (pollfds == NULL || sources == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+  }
+
+  pollfds[source_count] = (struct pollfd){ .fd = fd, .events = events };
+  sources[source_count] = (EventSource){ .callback = callback, .data = data };
+  source_count++;
+}
+
+void event_modify(int fd, short events)
+{
+  int i = find_source(fd);
+
+  if (i > 0)
+    pollfds[i].events = events;
+}
+
+void event_remove(int fd)
+{
+  int i = find_source(fd);
+
+  /* compacted after dispatching, callbacks may remove other sources */
+  if (i > 0)
+    pollfds[i].fd = -1;
+}
+
+static void compact()
+{
+  int j = 1;
+
+  for (int i = 1; i < source_count; i++) {
+    if (pollfds[i].fd < 0)
+      continue;
+    pollfds[j] = pollfds[i];
+    sources[j] = sources[i];
+    j++;
+  }
+  source_count = j;
+}
+
+static double now_seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* dispatch events until a signal arrives or timeout expires (NULL waits
+ * forever), returns the signal number or 0 on timeout */
+int event_wait(struct timespec *timeout)
+{
+  struct signalfd_siginfo info;
+  struct timespec remaining;
+  double deadline = 0;
+  double left;
+  int ready;
+  int count;
+
+  if (timeout)
+    deadline = now_seconds() + timeout->tv_sec + timeout->tv_nsec / 1e9;
+
+  for (;;) {
+    if (timeout) {
+      left = deadline - now_seconds();
+      if (left <= 0)
+        return 0;
+      remaining.tv_sec = left;
+      remaining.tv_nsec = (left - remaining.tv_sec) * 1e9;
+    }
+
+    ready = ppoll(pollfds, source_count, timeout ? &remaining : NULL, NULL);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      err(EXIT_FAILURE, "Could not wait for events");
+    }
+
+    if (pollfds[0].revents & POLLIN) {
+      if (read(pollfds[0].fd, &info, sizeof(info)) == sizeof(info))
+        return info.ssi_signo;
+    }
+
+    count = source_count;
+    for (int i = 1; i < count; i++)
+      if (pollfds[i].fd >= 0 && pollfds[i].revents)
+        sources[i].callback(pollfds[i].fd, pollfds[i].revents, sources[i].data);
+    compact();
+  }
+}
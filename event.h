@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+typedef void (*EventCallback)(int fd, short revents, void *data);
+
+void event_init(sigset_t *signals);
+void event_add(int fd, short events, EventCallback callback, void *data);
+void event_modify(int fd, short events);
+void event_remove(int fd);
+int event_wait(struct timespec *timeout);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <glob.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "battery.h"
+#include "freeze.h"
+
+static char **patterns = NULL;
+static int pattern_count = 0;
+static char *cgroup_root = NULL;
+
+/* freeze files written by us, so exactly those are thawed */
+static glob_t frozen;
+static bool is_frozen = false;
+
+static double frozen_at;
+static int64_t frozen_energy;
+static double frozen_rate;
+
+static double now_seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool write_freeze(char *path, char *value)
+{
+  FILE *file;
+  bool ok;
+
+  file = fopen(path, "w");
+  if (file == NULL) {
+    warn("Could not open %s", path);
+    return false;
+  }
+  ok = fputs(value, file) >= 0;
+  ok &= fclose(file) == 0;
+  if (!ok)
+    warn("Could not write %s", path);
+  return ok;
+}
+
+void freeze_init(char *root, char **cgroups, int count)
+{
+  cgroup_root = realloc(cgroup_root, strlen(root) + strlen(CGROUP_SUBSYSTEM) + 1);
+  if (cgroup_root == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  strcpy(cgroup_root, root);
+  strcat(cgroup_root, CGROUP_SUBSYSTEM);
+  patterns = cgroups;
+  pattern_count = count;
+}
+
+void freeze_cgroups(BatteryState *battery)
+{
+  char *pattern;
+  int flags = 0;
+  size_t count = 0;
+
+  if (is_frozen || pattern_count == 0)
+    return;
+
+  /* cgroup names may be glob patterns, scopes are often named dynamically */
+  for (int i = 0; i < pattern_count; i++) {
+    pattern = malloc(strlen(cgroup_root) + strlen(patterns[i]) + strlen(CGROUP_FREEZE) + 3);
+    if (pattern == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    sprintf(pattern, "%s/%s/" CGROUP_FREEZE, cgroup_root, patterns[i]);
+    glob(pattern, flags, NULL, &frozen);
+    flags = GLOB_APPEND;
+    free(pattern);
+  }
+
+  is_frozen = true;
+  frozen_at = now_seconds();
+  frozen_energy = battery->energy_now;
+  frozen_rate = battery->rate;
+
+  for (size_t i = 0; i < frozen.gl_pathc; i++)
+    if (write_freeze(frozen.gl_pathv[i], "1"))
+      count++;
+    else
+      frozen.gl_pathv[i][0] = '\0';
+
+  printf("Froze %zu cgroups at %d%%\n", count, battery->level);
+  fflush(stdout);
+}
+
+void thaw_cgroups(BatteryState *battery)
+{
+  double elapsed;
+  double used;
+  double rate;
+
+  if (!is_frozen)
+    return;
+
+  for (size_t i = 0; i < frozen.gl_pathc; i++)
+    if (frozen.gl_pathv[i][0] != '\0')
+      write_freeze(frozen.gl_pathv[i], "0");
+  globfree(&frozen);
+  is_frozen = false;
+
+  if (battery == NULL)
+    return;
+
+  /* runtime gained: how long the energy used while frozen lasted compared
+   * to how long it would have lasted at the drain rate before freezing */
+  elapsed = now_seconds() - frozen_at;
+  used = frozen_energy - battery->energy_now;
+  if (frozen_rate > 0 && used > 0 && elapsed > 0) {
+    rate = used / elapsed;
+    printf("Thawed cgroups after %.0f min, drain %.1f%%/h frozen vs %.1f%%/h before, about %.0f min gained\n",
+        elapsed / 60, 360000 * rate / battery->energy_full, 360000 * frozen_rate / battery->energy_full,
+        (elapsed - used / frozen_rate) / 60);
+  } else {
+    printf("Thawed cgroups after %.0f min\n", elapsed / 60);
+  }
+  fflush(stdout);
+}
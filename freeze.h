@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef FREEZE_H
+#define FREEZE_H
+
+#include "battery.h"
+
+/* system paths */
+#define CGROUP_SUBSYSTEM "/sys/fs/cgroup"
+#define CGROUP_FREEZE "cgroup.freeze"
+
+void freeze_init(char *root, char **cgroups, int count);
+void freeze_cgroups(BatteryState *battery);
+void thaw_cgroups(BatteryState *battery);
+
+#endif
@@ -1,144 +1,639 @@
 #include "fullscreen.h"
 
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <X11/Xatom.h>
-#include <X11/Xft/Xft.h>  // Add Xft headers
+#include <xcb/xcb.h>
+#include <xcb/randr.h>
+#include <fontconfig/fontconfig.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 const char* message = "BATTERY CRITICALLY LOW";
 
-int fullscreen() {
-    Display *display;
-    Window window;
-    XEvent event;
-    int screen;
-    GC gc;
+/* Fonts tried in order, the first one fontconfig can match is used */
+const char* font_pattern = "Liberation Mono,monospace:bold";
+const double font_points = 64.0;
+const double status_points = 32.0;
 
-    /* Open display */
-    display = XOpenDisplay(NULL);
-    if (display == NULL) {
-        fprintf(stderr, "ERROR: fullscreen: Cannot open display\n");
-        return 1;
+/* Red background */
+#define BACKGROUND 0xFF0000
+
+/* Core fonts tried in order when the text cannot be rendered with FreeType,
+ * every server has "fixed" */
+const char* core_fonts[] = {
+    "-*-helvetica-bold-r-normal--34-*-*-*-*-*-iso8859-1",
+    "-*-*-bold-r-*--34-*-*-*-*-*-iso8859-1",
+    "fixed",
+};
+
+/* Longest status line shown under the message */
+#define STATUS_LENGTH 128
+
+/* One window per monitor, each with the message centred on it */
+typedef struct Head {
+    int x;
+    int y;
+    int width;
+    int height;
+    xcb_window_t window;
+    xcb_pixmap_t pixmap;
+} Head;
+
+/* Extents of a line of text, in pixels */
+typedef struct Extents {
+    int width;
+    int ascent;
+    int descent;
+} Extents;
+
+/* the prepared alert, driven from the daemon's event loop */
+static xcb_connection_t *connection = NULL;
+static xcb_screen_t *screen;
+static Head *heads = NULL;
+static int head_count = 0;
+static xcb_atom_t wm_state;
+static xcb_atom_t fullscreen;
+static int mapped = 0;
+
+/* How pixels are stored for the root depth, the text is converted to it */
+static const xcb_format_t *format = NULL;
+static xcb_visualtype_t *visual = NULL;
+static uint32_t background_pixel;
+static xcb_gcontext_t gc;
+
+/* Without FreeType or a true colour visual the text is drawn by the server
+ * with a core font, the alert is never shown without its text */
+static xcb_font_t core_font = XCB_NONE;
+static xcb_gcontext_t core_gc;
+static int core_ascent;
+static int core_descent;
+
+/* The status line is redrawn for the life of the alert */
+static FT_Library library = NULL;
+static FT_Face status_face = NULL;
+static char status[STATUS_LENGTH] = "";
+
+/* Block until the server has handled everything sent so far */
+static void sync_connection() {
+    free(xcb_get_input_focus_reply(connection, xcb_get_input_focus(connection), NULL));
+}
+
+static xcb_atom_t atom_reply(xcb_intern_atom_cookie_t cookie) {
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(connection, cookie, NULL);
+    xcb_atom_t atom = reply ? reply->atom : XCB_ATOM_NONE;
+
+    free(reply);
+    return atom;
+}
+
+/* Image format the server uses for the root depth */
+static const xcb_format_t *find_format() {
+    xcb_format_iterator_t formats = xcb_setup_pixmap_formats_iterator(xcb_get_setup(connection));
+
+    for (; formats.rem; xcb_format_next(&formats))
+        if (formats.data->depth == screen->root_depth)
+            return formats.data;
+    return NULL;
+}
+
+static xcb_visualtype_t *find_visual() {
+    xcb_depth_iterator_t depths = xcb_screen_allowed_depths_iterator(screen);
+
+    for (; depths.rem; xcb_depth_next(&depths)) {
+        xcb_visualtype_iterator_t visuals = xcb_depth_visuals_iterator(depths.data);
+        for (; visuals.rem; xcb_visualtype_next(&visuals))
+            if (visuals.data->visual_id == screen->root_visual)
+                return visuals.data;
     }
+    return NULL;
+}
 
-    screen = DefaultScreen(display);
+/* Client side rendering needs pixels that are plain sums of colour masks */
+static int images_supported() {
+    return format && visual && visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR
+        && (format->bits_per_pixel == 8 || format->bits_per_pixel == 16
+            || format->bits_per_pixel == 24 || format->bits_per_pixel == 32);
+}
 
-    /* Get screen dimensions */
-    int screen_width = DisplayWidth(display, screen);
-    int screen_height = DisplayHeight(display, screen);
+/* Scale an 8 bit channel into the bits of a colour mask */
+static uint32_t channel(uint32_t value, uint32_t mask) {
+    int shift = 0;
+    int bits = 0;
 
-    /* Create window at full screen size */
-    window = XCreateSimpleWindow(display, RootWindow(display, screen),
-                                0, 0, screen_width, screen_height, 0,
-                                BlackPixel(display, screen), 
-                                0xFF0000); /* Red background */
+    if (mask == 0)
+        return 0;
+    while (!(mask >> shift & 1))
+        shift++;
+    while (mask >> (shift + bits) & 1)
+        bits++;
+    value = bits < 8 ? value >> (8 - bits) : value << (bits - 8);
+    return (value << shift) & mask;
+}
 
-    /* Set window name and class */
-    XStoreName(display, window, "Critical Warning");
+/* Pixel value of a 0xRRGGBB colour in the root visual */
+static uint32_t pixel_value(uint32_t rgb) {
+    return channel(rgb >> 16 & 0xFF, visual->red_mask)
+        | channel(rgb >> 8 & 0xFF, visual->green_mask)
+        | channel(rgb & 0xFF, visual->blue_mask);
+}
 
-    XClassHint class_hint;
-    class_hint.res_name = "critical_warning";
-    class_hint.res_class = "CriticalWarning";
-    XSetClassHint(display, window, &class_hint);
+/* Store 0xRRGGBB pixels in the server's pixmap format and byte order,
+ * returns the bytes per row or 0 if out of memory */
+static int encode(const uint32_t *band, int width, int rows, uint8_t **data) {
+    int bytes = format->bits_per_pixel / 8;
+    int stride = (width * format->bits_per_pixel + format->scanline_pad - 1)
+        / format->scanline_pad * format->scanline_pad / 8;
+    int msb = xcb_get_setup(connection)->image_byte_order == XCB_IMAGE_ORDER_MSB_FIRST;
 
-    /* Make the window fullscreen */
-    Atom wm_state = XInternAtom(display, "_NET_WM_STATE", False);
-    Atom fullscreen = XInternAtom(display, "_NET_WM_STATE_FULLSCREEN", False);
+    *data = calloc(rows, stride);
+    if (*data == NULL)
+        return 0;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < width; c++) {
+            uint32_t value = pixel_value(band[r * width + c]);
+            uint8_t *out = *data + r * stride + c * bytes;
+            for (int b = 0; b < bytes; b++)
+                out[msb ? bytes - 1 - b : b] = value >> (8 * b);
+        }
+    }
+    return stride;
+}
 
-    XEvent fullscreen_event;
-    memset(&fullscreen_event, 0, sizeof(fullscreen_event));
+/* Open the first core font the server has */
+static void open_core_font() {
+    for (size_t i = 0; i < sizeof(core_fonts) / sizeof(core_fonts[0]); i++) {
+        xcb_font_t font = xcb_generate_id(connection);
+        xcb_generic_error_t *error = xcb_request_check(connection,
+            xcb_open_font_checked(connection, font, strlen(core_fonts[i]), core_fonts[i]));
+        if (error) {
+            free(error);
+            continue;
+        }
 
-    fullscreen_event.type = ClientMessage;
-    fullscreen_event.xclient.window = window;
-    fullscreen_event.xclient.message_type = wm_state;
-    fullscreen_event.xclient.format = 32;
-    fullscreen_event.xclient.data.l[0] = 1;  // _NET_WM_STATE_ADD
-    fullscreen_event.xclient.data.l[1] = fullscreen;
-    fullscreen_event.xclient.data.l[2] = 0;
+        xcb_query_font_reply_t *info = xcb_query_font_reply(connection, xcb_query_font(connection, font), NULL);
+        core_font = font;
+        core_ascent = info ? info->font_ascent : 0;
+        core_descent = info ? info->font_descent : 0;
+        free(info);
 
-    /* Select inputs */
-    XSelectInput(display, window, ExposureMask | KeyPressMask);
+        uint32_t values[] = { screen->white_pixel, background_pixel, core_font };
+        core_gc = xcb_generate_id(connection);
+        xcb_create_gc(connection, core_gc, screen->root,
+                      XCB_GC_FOREGROUND | XCB_GC_BACKGROUND | XCB_GC_FONT, values);
+        return;
+    }
+    fprintf(stderr, "ERROR: fullscreen: Cannot open a core font\n");
+}
+
+/* Background colour, allocated when the visual has a colour map */
+static uint32_t find_background() {
+    xcb_alloc_color_reply_t *color;
+    uint32_t pixel = screen->black_pixel;
+
+    if (visual && visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR)
+        return pixel_value(BACKGROUND);
+    color = xcb_alloc_color_reply(connection, xcb_alloc_color(connection, screen->default_colormap,
+        (BACKGROUND >> 16 & 0xFF) * 0x101, (BACKGROUND >> 8 & 0xFF) * 0x101, (BACKGROUND & 0xFF) * 0x101), NULL);
+    if (color)
+        pixel = color->pixel;
+    free(color);
+    return pixel;
+}
 
-    /* Create GC for basic X11 operations */
-    gc = XCreateGC(display, window, 0, 0);
+static FT_Face open_font(double points) {
+    FcPattern *pattern = FcNameParse((const FcChar8 *)font_pattern);
+    FcPattern *match;
+    FcResult result;
+    FcChar8 *file;
+    int index = 0;
+    int dpi = 96;
+    FT_Face face = NULL;
 
-    /* Initialize Xft drawing */
-    Visual *visual = DefaultVisual(display, screen);
-    Colormap colormap = DefaultColormap(display, screen);
+    /* Same resolution Xft assumes without an Xft.dpi resource */
+    if (screen->height_in_millimeters)
+        dpi = screen->height_in_pixels * 25.4 / screen->height_in_millimeters;
 
-    /* Create Xft font */
-    XftFont *xft_font = XftFontOpen(display, screen,
-                                   XFT_FAMILY, XftTypeString, "Liberation Mono",
-                                   XFT_WEIGHT, XftTypeInteger, XFT_WEIGHT_BOLD,
-                                   XFT_SIZE, XftTypeDouble, 64.0,
-                                   NULL);
+    FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+    FcDefaultSubstitute(pattern);
+    match = FcFontMatch(NULL, pattern, &result);
+    FcPatternDestroy(pattern);
 
-    if (!xft_font) {
-        fprintf(stderr, "ERROR: fullscreen: Cannot load Liberation Mono font, trying fallback\n");
-        xft_font = XftFontOpen(display, screen,
-                              XFT_FAMILY, XftTypeString, "monospace",
-                              XFT_WEIGHT, XftTypeInteger, XFT_WEIGHT_BOLD,
-                              XFT_SIZE, XftTypeDouble, 64.0,
-                              NULL);
+    if (match == NULL || FcPatternGetString(match, FC_FILE, 0, &file) != FcResultMatch) {
+        fprintf(stderr, "ERROR: fullscreen: Cannot find a font for %s\n", font_pattern);
+    } else {
+        FcPatternGetInteger(match, FC_INDEX, 0, &index);
+        if (FT_New_Face(library, (const char *)file, index, &face) != 0) {
+            fprintf(stderr, "ERROR: fullscreen: Cannot load font %s\n", file);
+            face = NULL;
+        } else {
+            FT_Set_Char_Size(face, 0, points * 64, dpi, dpi);
+        }
     }
 
-    /* Create Xft colors */
-    XftColor xft_color;
-    XRenderColor render_color;
-    render_color.red = 0xFFFF;    /* White text (full red component) */
-    render_color.green = 0xFFFF;  /* White text (full green component) */
-    render_color.blue = 0xFFFF;   /* White text (full blue component) */
-    render_color.alpha = 0xFFFF;  /* Fully opaque */
+    if (match)
+        FcPatternDestroy(match);
+    return face;
+}
 
-    XftColorAllocValue(display, visual, colormap, &render_color, &xft_color);
+/* Calculate text size for centering */
+static Extents measure(FT_Face face, const char *text) {
+    Extents extents = { 0, 0, 0 };
 
-    /* Create Xft draw context */
-    XftDraw *xft_draw = XftDrawCreate(display, window, visual, colormap);
+    for (size_t i = 0; text[i]; i++) {
+        if (FT_Load_Char(face, (unsigned char)text[i], FT_LOAD_DEFAULT) != 0)
+            continue;
+        FT_Glyph_Metrics *metrics = &face->glyph->metrics;
+        extents.width += face->glyph->advance.x >> 6;
+        if (metrics->horiBearingY >> 6 > extents.ascent)
+            extents.ascent = metrics->horiBearingY >> 6;
+        if ((metrics->height - metrics->horiBearingY) >> 6 > extents.descent)
+            extents.descent = (metrics->height - metrics->horiBearingY) >> 6;
+    }
+    return extents;
+}
 
-    /* Map window */
-    XMapRaised(display, window);
+/* Clear the band and let the server draw the line with the core font */
+static void draw_core_line(const char *text, xcb_pixmap_t target, int width,
+                           int baseline, int top, int rows) {
+    xcb_rectangle_t area = { 0, top, width, rows };
+    size_t length = strlen(text) < 255 ? strlen(text) : 255;
+    xcb_char2b_t wide[255];
+    int x = 0;
 
-    /* Send fullscreen event */
-    XSendEvent(display, RootWindow(display, screen), False,
-               SubstructureNotifyMask | SubstructureRedirectMask,
-               &fullscreen_event);
+    xcb_poly_fill_rectangle(connection, target, gc, 1, &area);
+    if (core_font == XCB_NONE || length == 0)
+        return;
 
-    XFlush(display);
+    for (size_t i = 0; i < length; i++)
+        wide[i] = (xcb_char2b_t){ 0, (uint8_t)text[i] };
+    xcb_query_text_extents_reply_t *extents = xcb_query_text_extents_reply(connection,
+        xcb_query_text_extents(connection, core_font, length, wide), NULL);
+    if (extents)
+        x = (width - extents->overall_width) / 2;
+    free(extents);
 
-    /* Event loop */
-    while (1) {
-        XNextEvent(display, &event);
+    xcb_image_text_8(connection, length, target, core_gc, x, baseline, text);
+}
+
+/* Rasterize a centred line into a band of rows on the client and copy it
+ * into the pixmap, splitting the band so each request fits the server's
+ * maximum length. The whole band is replaced, so older text is erased. */
+static void draw_line(FT_Face face, const char *text, xcb_pixmap_t target,
+                      int width, int height, int baseline, int top, int rows) {
+    if (top < 0) {
+        rows += top;
+        top = 0;
+    }
+    if (top + rows > height)
+        rows = height - top;
+    if (rows <= 0)
+        return;
+    if (face == NULL) {
+        draw_core_line(text, target, width, baseline, top, rows);
+        return;
+    }
 
-        if (event.type == Expose) {
-            if (xft_font) {
-                /* Calculate text size for centering */
-                XGlyphInfo extents;
-                XftTextExtents8(display, xft_font, (XftChar8 *)message, strlen(message), &extents);
+    uint32_t *band = malloc(sizeof(uint32_t) * width * rows);
+    uint8_t *data;
+    int x = (width - measure(face, text).width) / 2;
 
-                int x = (screen_width - extents.width) / 2;
-                int y = (screen_height + extents.height) / 2;
+    if (band == NULL)
+        return;
+    for (int i = 0; i < width * rows; i++)
+        band[i] = BACKGROUND;
 
-                /* Draw text with Xft for high-quality rendering */
-                XftDrawString8(xft_draw, &xft_color, xft_font, x, y,
-                               (XftChar8 *)message, strlen(message));
+    /* White text: glyph coverage raises green and blue over the red */
+    for (size_t i = 0; text[i]; i++) {
+        if (FT_Load_Char(face, (unsigned char)text[i], FT_LOAD_RENDER) != 0)
+            continue;
+        FT_GlyphSlot glyph = face->glyph;
+        FT_Bitmap *bitmap = &glyph->bitmap;
+
+        for (unsigned int r = 0; r < bitmap->rows; r++) {
+            int py = baseline - glyph->bitmap_top + r - top;
+            if (py < 0 || py >= rows)
+                continue;
+            for (unsigned int c = 0; c < bitmap->width; c++) {
+                int px = x + glyph->bitmap_left + c;
+                unsigned int a = bitmap->buffer[r * bitmap->pitch + c];
+                if (px < 0 || px >= width || a == 0)
+                    continue;
+                uint32_t *pixel = &band[py * width + px];
+                unsigned int g = ((*pixel >> 8) & 0xFF) > a ? (*pixel >> 8) & 0xFF : a;
+                *pixel = BACKGROUND | g << 8 | g;
             }
-        } else if (event.type == KeyPress) {
-            break; /* Exit on any keypress */
         }
+        x += glyph->advance.x >> 6;
     }
 
-    /* Clean up */
-    if (xft_font) XftFontClose(display, xft_font);
-    XftDrawDestroy(xft_draw);
-    XftColorFree(display, visual, colormap, &xft_color);
+    int stride = encode(band, width, rows, &data);
+    free(band);
+    if (stride == 0)
+        return;
+
+    int max_rows = (xcb_get_maximum_request_length(connection) * 4 - 32) / stride;
+    if (max_rows < 1)
+        max_rows = 1;
+    for (int r = 0; r < rows; r += max_rows) {
+        int count = rows - r < max_rows ? rows - r : max_rows;
+        xcb_put_image(connection, XCB_IMAGE_FORMAT_Z_PIXMAP, target, gc,
+                      width, count, 0, top + r, 0, screen->root_depth,
+                      stride * count, data + r * stride);
+    }
+
+    free(data);
+}
+
+/* Band of the status line: one line of the status font, one line below
+ * the middle of the monitor */
+static void status_band(Head *head, int *baseline, int *top, int *rows) {
+    int line = core_ascent + core_descent;
+    int ascent = core_ascent;
+
+    if (status_face) {
+        line = status_face->size->metrics.height >> 6;
+        ascent = status_face->size->metrics.ascender >> 6;
+    }
+    *top = head->height / 2 + line;
+    *rows = line;
+    *baseline = *top + ascent;
+}
+
+/* Draw the status line into the head's pixmap; the window shows the new
+ * line only when the server repaints it from the pixmap, so it changes in
+ * one step without flicker */
+static void draw_status(Head *head) {
+    int baseline, top, rows;
+
+    status_band(head, &baseline, &top, &rows);
+    draw_line(status_face, status, head->pixmap, head->width, head->height, baseline, top, rows);
+    if (mapped)
+        xcb_clear_area(connection, 0, head->window, 0, top, head->width, rows);
+}
+
+/* Collect the active CRTCs, all info requests are sent before the first
+ * reply is read. Falls back to a single head covering the screen. */
+static void find_heads(xcb_randr_get_screen_resources_current_cookie_t cookie, int randr) {
+    xcb_randr_get_screen_resources_current_reply_t *resources = NULL;
+    xcb_randr_get_crtc_info_cookie_t *cookies = NULL;
+    xcb_randr_crtc_t *crtcs = NULL;
+    int crtc_count = 0;
+
+    head_count = 0;
+    if (randr)
+        resources = xcb_randr_get_screen_resources_current_reply(connection, cookie, NULL);
+    if (resources) {
+        crtcs = xcb_randr_get_screen_resources_current_crtcs(resources);
+        crtc_count = xcb_randr_get_screen_resources_current_crtcs_length(resources);
+        cookies = malloc(sizeof(*cookies) * crtc_count);
+        heads = malloc(sizeof(Head) * (crtc_count > 0 ? crtc_count : 1));
+    } else {
+        heads = malloc(sizeof(Head));
+    }
+    if (heads == NULL || (crtc_count > 0 && cookies == NULL))
+        crtc_count = 0;
+
+    for (int i = 0; i < crtc_count; i++)
+        cookies[i] = xcb_randr_get_crtc_info(connection, crtcs[i], resources->config_timestamp);
 
-    XFreeGC(display, gc);
-    XDestroyWindow(display, window);
-    XCloseDisplay(display);
+    for (int i = 0; i < crtc_count; i++) {
+        xcb_randr_get_crtc_info_reply_t *crtc = xcb_randr_get_crtc_info_reply(connection, cookies[i], NULL);
+        if (crtc && crtc->mode != XCB_NONE && crtc->width && crtc->height)
+            heads[head_count++] = (Head){ crtc->x, crtc->y, crtc->width, crtc->height, 0, 0 };
+        free(crtc);
+    }
+    free(cookies);
+    free(resources);
+
+    if (heads && head_count == 0)
+        heads[head_count++] = (Head){ 0, 0, screen->width_in_pixels, screen->height_in_pixels, 0, 0 };
+}
+
+static void free_fonts() {
+    if (status_face)
+        FT_Done_Face(status_face);
+    if (library)
+        FT_Done_FreeType(library);
+    status_face = NULL;
+    library = NULL;
+    core_font = XCB_NONE;
+}
+
+int fullscreen_prepare() {
+    xcb_randr_get_screen_resources_current_cookie_t resources_cookie = { 0 };
+    const xcb_query_extension_reply_t *randr;
+    FT_Face message_face = NULL;
+    Extents extents = { 0, 0, 0 };
+
+    if (connection != NULL)
+        return 0;
+
+    /* Open display */
+    connection = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(connection)) {
+        fprintf(stderr, "ERROR: fullscreen: Cannot open display\n");
+        xcb_disconnect(connection);
+        connection = NULL;
+        return -1;
+    }
+
+    screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
+
+    /* Intern atoms now, the replies are collected after the drawing */
+    const char *state_name = "_NET_WM_STATE";
+    const char *fullscreen_name = "_NET_WM_STATE_FULLSCREEN";
+    xcb_intern_atom_cookie_t state_cookie =
+        xcb_intern_atom(connection, 0, strlen(state_name), state_name);
+    xcb_intern_atom_cookie_t fullscreen_cookie =
+        xcb_intern_atom(connection, 0, strlen(fullscreen_name), fullscreen_name);
+
+    /* Ask for the monitor layout, it arrives while the fonts load */
+    randr = xcb_get_extension_data(connection, &xcb_randr_id);
+    if (randr && randr->present)
+        resources_cookie = xcb_randr_get_screen_resources_current(connection, screen->root);
+
+    format = find_format();
+    visual = find_visual();
+    background_pixel = find_background();
+    if (images_supported() && FT_Init_FreeType(&library) != 0)
+        library = NULL;
+    if (library) {
+        message_face = open_font(font_points);
+        status_face = open_font(status_points);
+    }
+    if (message_face == NULL || status_face == NULL)
+        open_core_font();
+
+    find_heads(resources_cookie, randr && randr->present);
+    if (heads == NULL) {
+        if (message_face)
+            FT_Done_Face(message_face);
+        free_fonts();
+        xcb_disconnect(connection);
+        connection = NULL;
+        return -1;
+    }
+
+    /* Render the message into a pixmap per head, the server paints it as
+     * the window background so no drawing is left for the moment of danger */
+    uint32_t gc_values[] = { background_pixel };
+    gc = xcb_generate_id(connection);
+    xcb_create_gc(connection, gc, screen->root, XCB_GC_FOREGROUND, gc_values);
+
+    if (message_face)
+        extents = measure(message_face, message);
+    else
+        extents = (Extents){ 0, core_ascent, core_descent };
+
+    const char *name = "Critical Warning";
+    const char class_hint[] = "critical_warning\0CriticalWarning";
+
+    for (int i = 0; i < head_count; i++) {
+        Head *head = &heads[i];
+        xcb_rectangle_t area = { 0, 0, head->width, head->height };
+
+        head->pixmap = xcb_generate_id(connection);
+        xcb_create_pixmap(connection, screen->root_depth, head->pixmap, screen->root,
+                          head->width, head->height);
+        xcb_poly_fill_rectangle(connection, head->pixmap, gc, 1, &area);
+        int baseline = (head->height + extents.ascent) / 2;
+        draw_line(message_face, message, head->pixmap, head->width, head->height,
+                  baseline, baseline - extents.ascent, extents.ascent + extents.descent);
+        draw_status(head);
+
+        /* Create window covering the monitor */
+        uint32_t window_values[] = { head->pixmap, screen->black_pixel, XCB_EVENT_MASK_KEY_PRESS };
+
+        head->window = xcb_generate_id(connection);
+        xcb_create_window(connection, XCB_COPY_FROM_PARENT, head->window, screen->root,
+                          head->x, head->y, head->width, head->height, 0,
+                          XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
+                          XCB_CW_BACK_PIXMAP | XCB_CW_BORDER_PIXEL | XCB_CW_EVENT_MASK,
+                          window_values);
+
+        /* Set window name and class */
+        xcb_change_property(connection, XCB_PROP_MODE_REPLACE, head->window, XCB_ATOM_WM_NAME,
+                            XCB_ATOM_STRING, 8, strlen(name), name);
+        xcb_change_property(connection, XCB_PROP_MODE_REPLACE, head->window, XCB_ATOM_WM_CLASS,
+                            XCB_ATOM_STRING, 8, sizeof(class_hint), class_hint);
+    }
+    if (message_face)
+        FT_Done_Face(message_face);
+
+    /* Ask for fullscreen before the windows are first mapped */
+    wm_state = atom_reply(state_cookie);
+    fullscreen = atom_reply(fullscreen_cookie);
+    if (wm_state != XCB_ATOM_NONE && fullscreen != XCB_ATOM_NONE)
+        for (int i = 0; i < head_count; i++)
+            xcb_change_property(connection, XCB_PROP_MODE_REPLACE, heads[i].window, wm_state,
+                                XCB_ATOM_ATOM, 32, 1, &fullscreen);
+
+    /* Wait until the server has done all the work */
+    sync_connection();
 
     return 0;
 }
+
+int fullscreen_open() {
+    if (fullscreen_prepare() < 0)
+        return -1;
+    if (mapped)
+        return xcb_get_file_descriptor(connection);
+
+    /* Map all windows on top, then wait for the server once */
+    uint32_t stack[] = { XCB_STACK_MODE_ABOVE };
+    for (int i = 0; i < head_count; i++) {
+        xcb_configure_window(connection, heads[i].window, XCB_CONFIG_WINDOW_STACK_MODE, stack);
+        xcb_map_window(connection, heads[i].window);
+    }
+
+    /* Send fullscreen events, the window manager keeps each on its monitor */
+    for (int i = 0; wm_state != XCB_ATOM_NONE && fullscreen != XCB_ATOM_NONE && i < head_count; i++) {
+        xcb_client_message_event_t fullscreen_event;
+        memset(&fullscreen_event, 0, sizeof(fullscreen_event));
+
+        fullscreen_event.response_type = XCB_CLIENT_MESSAGE;
+        fullscreen_event.window = heads[i].window;
+        fullscreen_event.type = wm_state;
+        fullscreen_event.format = 32;
+        fullscreen_event.data.data32[0] = 1;  // _NET_WM_STATE_ADD
+        fullscreen_event.data.data32[1] = fullscreen;
+
+        xcb_send_event(connection, 0, screen->root,
+                       XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY | XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT,
+                       (const char *)&fullscreen_event);
+    }
+
+    sync_connection();
+    mapped = 1;
+
+    return xcb_get_file_descriptor(connection);
+}
+
+/* Replace the status line, nothing is sent unless the text changed */
+void fullscreen_update(const char *text) {
+    if (strncmp(status, text, STATUS_LENGTH - 1) == 0)
+        return;
+
+    strncpy(status, text, STATUS_LENGTH - 1);
+    if (connection == NULL)
+        return;
+
+    for (int i = 0; i < head_count; i++)
+        draw_status(&heads[i]);
+    xcb_flush(connection);
+}
+
+/* handle queued events, returns 1 once the alert is dismissed */
+int fullscreen_dispatch() {
+    xcb_generic_event_t *event;
+    int dismissed = 0;
+
+    if (connection == NULL)
+        return 1;
+
+    while ((event = xcb_poll_for_event(connection))) {
+        if ((event->response_type & ~0x80) == XCB_KEY_PRESS)
+            dismissed = 1; /* Dismiss on any keypress */
+        free(event);
+    }
+
+    return dismissed || xcb_connection_has_error(connection);
+}
+
+/* unmap the windows but keep them ready to be shown again */
+void fullscreen_hide() {
+    if (connection == NULL || !mapped)
+        return;
+
+    for (int i = 0; i < head_count; i++)
+        xcb_unmap_window(connection, heads[i].window);
+    xcb_flush(connection);
+    mapped = 0;
+}
+
+void fullscreen_close() {
+    if (connection == NULL)
+        return;
+
+    /* Clean up */
+    for (int i = 0; i < head_count; i++) {
+        xcb_free_pixmap(connection, heads[i].pixmap);
+        xcb_destroy_window(connection, heads[i].window);
+    }
+    free(heads);
+    heads = NULL;
+    head_count = 0;
+    xcb_free_gc(connection, gc);
+    if (core_font != XCB_NONE) {
+        xcb_free_gc(connection, core_gc);
+        xcb_close_font(connection, core_font);
+    }
+    free_fonts();
+    xcb_disconnect(connection);
+    connection = NULL;
+    mapped = 0;
+    status[0] = '\0';
+}
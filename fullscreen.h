@@ -6,6 +6,11 @@
 #ifndef FULLSCREEN_H
 #define FULLSCREEN_H
 
-int fullscreen();
+int fullscreen_prepare();
+int fullscreen_open();
+void fullscreen_update(const char *text);
+int fullscreen_dispatch();
+void fullscreen_hide();
+void fullscreen_close();
 
 #endif
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "battery.h"
+#include "group.h"
+#include "metrics.h"
+#include "notify.h"
+#include "options.h"
+
+static Group *groups = NULL;
+static int group_count = 0;
+
+static Template* default_message(char *format, char *name)
+{
+  Template *template;
+  char *message;
+
+  if (asprintf(&message, format, name) < 0)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  template = template_compile(message, false);
+  free(message);
+  return template;
+}
+
+static char* copy(char *value)
+{
+  char *copy = strdup(value ? value : "");
+
+  if (copy == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  return copy;
+}
+
+/* parsed like the global levels, but groups have no levels in minutes */
+static int parse_level(char *value, char *key)
+{
+  int level = -1;
+  int minutes = -1;
+
+  if (value == NULL || !read_level(value, &level, &minutes) || level < 0 || level > 100)
+    errx(EXIT_FAILURE, "Group %s must be a percentage between 0 and 100.", key);
+  return level;
+}
+
+/* name=NAME,batteries=BAT1+BAT2 followed by optional warning, critical,
+ * danger and full levels, warningmsg, criticalmsg, fullmsg and dangercmd */
+int parse_group(char *spec, Group **groups, int count)
+{
+  char *value;
+  char *member;
+  char *const keys[] = {
+    "name", "batteries", "warning", "critical", "danger", "full",
+    "warningmsg", "criticalmsg", "fullmsg", "dangercmd", NULL
+  };
+  Group *group;
+
+  *groups = realloc(*groups, sizeof(Group) * (count + 1));
+  if (*groups == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  group = &(*groups)[count];
+  *group = (Group){
+    .spec = strdup(spec), .name = NULL, .members = NULL, .member_count = 0,
+    .indexes = NULL, .warning = LEVEL_WARNING, .critical = LEVEL_CRITICAL,
+    .danger = LEVEL_DANGER, .full = LEVEL_FULL,
+    .warningmsg = NULL, .criticalmsg = NULL, .fullmsg = NULL, .dangercmd = NULL
+  };
+  if (group->spec == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+
+  while (*spec != '\0') {
+    switch (getsubopt(&spec, keys, &value)) {
+      case 0:
+        free(group->name);
+        group->name = copy(value);
+        break;
+      case 1:
+        for (member = value; member && *member != '\0'; member = value) {
+          value = strchr(member, GROUP_MEMBER_SEPARATOR);
+          if (value)
+            *value++ = '\0';
+          group->members = realloc(group->members, sizeof(char *) * (group->member_count + 1));
+          if (group->members == NULL)
+            err(EXIT_FAILURE, "Memory allocation failed");
+          group->members[group->member_count++] = copy(member);
+        }
+        break;
+      case 2:
+        group->warning = parse_level(value, keys[2]);
+        break;
+      case 3:
+        group->critical = parse_level(value, keys[3]);
+        break;
+      case 4:
+        group->danger = parse_level(value, keys[4]);
+        break;
+      case 5:
+        group->full = parse_level(value, keys[5]);
+        break;
+      case 6:
+        template_free(group->warningmsg);
+        group->warningmsg = template_compile(value ? value : "", false);
+        break;
+      case 7:
+        template_free(group->criticalmsg);
+        group->criticalmsg = template_compile(value ? value : "", false);
+        break;
+      case 8:
+        template_free(group->fullmsg);
+        group->fullmsg = template_compile(value ? value : "", false);
+        break;
+      case 9:
+        free(group->dangercmd);
+        group->dangercmd = copy(value);
+        break;
+      default:
+        errx(EXIT_FAILURE, "Unknown group option `%s'.", value);
+    }
+  }
+
+  if (group->name == NULL || *group->name == '\0')
+    errx(EXIT_FAILURE, "Group needs a name.");
+  if (group->member_count == 0)
+    errx(EXIT_FAILURE, "Group %s needs batteries.", group->name);
+  if (group->warning && group->warning <= group->critical)
+    errx(EXIT_FAILURE, "Group %s warning level must be greater than critical.", group->name);
+  if (group->critical && group->critical <= group->danger)
+    errx(EXIT_FAILURE, "Group %s critical level must be greater than danger.", group->name);
+
+  if (group->warningmsg == NULL)
+    group->warningmsg = default_message("Battery %s is low", group->name);
+  if (group->criticalmsg == NULL)
+    group->criticalmsg = default_message("Battery %s is critically low", group->name);
+  if (group->fullmsg == NULL)
+    group->fullmsg = default_message("Battery %s is full", group->name);
+  if (group->dangercmd == NULL)
+    group->dangercmd = copy("");
+
+  return count + 1;
+}
+
+void groups_free(Group *list, int count)
+{
+  for (int g = 0; g < count; g++) {
+    free(list[g].spec);
+    free(list[g].name);
+    for (int m = 0; m < list[g].member_count; m++)
+      free(list[g].members[m]);
+    free(list[g].members);
+    free(list[g].indexes);
+    template_free(list[g].warningmsg);
+    template_free(list[g].criticalmsg);
+    template_free(list[g].fullmsg);
+    free(list[g].dangercmd);
+  }
+  free(list);
+}
+
+/* members are read with the other batteries, so they must be monitored;
+ * false if one is not, leaving the running groups in place */
+bool groups_init(Group *list, int count, char **names, int name_count)
+{
+  Group *group;
+
+  for (int g = 0; g < count; g++) {
+    group = &list[g];
+    group->state = STATE_AC;
+    group->level = 0;
+    free(group->indexes);
+    group->indexes = malloc(sizeof(int) * group->member_count);
+    if (group->indexes == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+
+    for (int m = 0; m < group->member_count; m++) {
+      group->indexes[m] = -1;
+      for (int i = 0; i < name_count; i++)
+        if (strcmp(group->members[m], names[i]) == 0)
+          group->indexes[m] = i;
+      if (group->indexes[m] < 0) {
+        warnx("Battery %s of group %s is not monitored.", group->members[m], group->name);
+        return false;
+      }
+    }
+  }
+
+  groups = list;
+  group_count = count;
+  return true;
+}
+
+static void enter(Group *group, char state, Template *message, NotifyUrgency urgency, BatteryState *view)
+{
+  double start;
+
+  group->state = view->state = state;
+  printf("Group %s %s at %d%%\n", group->name, state_name(state), group->level);
+  fflush(stdout);
+
+  if (message)
+    notify(message, urgency, *view);
+  if (state == STATE_DANGER && group->dangercmd[0] != '\0') {
+    start = metrics_start();
+    if (system(group->dangercmd) == -1) { /* Ignore command errors... */ }
+    metrics_observe(METRIC_COMMAND, start);
+  }
+}
+
+/* the same levels as the main loop, from the samples it just read */
+static void update_group(Group *group, BatteryState *battery)
+{
+  BatteryState view = *battery;
+  long now = 0;
+  long full = 0;
+  bool discharging = false;
+  bool all_full = true;
+  int i;
+
+  for (int m = 0; m < group->member_count; m++) {
+    i = group->indexes[m];
+    now += battery->energies_now[i];
+    full += battery->energies_full[i];
+    discharging |= battery->statuses[i] == STATUS_DISCHARGING;
+    all_full &= battery->statuses[i] == STATUS_FULL;
+  }
+  group->level = full ? round(100.0 * now / full) : 0;
+
+  /* messages render with the group's own values */
+  view.level = group->level;
+  view.state = group->state;
+  view.discharging = discharging;
+  view.full = all_full;
+  view.energy_now = now;
+  view.energy_full = full;
+  view.rate = 0;
+  view.time_to_empty = -1;
+
+  if (discharging) {
+    if (group->danger && group->level <= group->danger) {
+      if (group->state != STATE_DANGER)
+        enter(group, STATE_DANGER, NULL, NOTIFY_URGENCY_CRITICAL, &view);
+    } else if (group->critical && group->level <= group->critical) {
+      if (group->state != STATE_CRITICAL)
+        enter(group, STATE_CRITICAL, group->criticalmsg, NOTIFY_URGENCY_CRITICAL, &view);
+    } else if (group->warning && group->level <= group->warning) {
+      if (group->state != STATE_WARNING)
+        enter(group, STATE_WARNING, group->warningmsg, NOTIFY_URGENCY_NORMAL, &view);
+    } else {
+      group->state = STATE_DISCHARGING;
+    }
+  } else if (group->full && group->state != STATE_FULL && (group->level >= group->full || all_full)) {
+    enter(group, STATE_FULL, group->fullmsg, NOTIFY_URGENCY_NORMAL, &view);
+  } else if (group->state != STATE_FULL) {
+    group->state = STATE_AC;
+  }
+}
+
+void groups_update(BatteryState *battery)
+{
+  for (int g = 0; g < group_count; g++)
+    update_group(&groups[g], battery);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <stdbool.h>
+#include "battery.h"
+#include "template.h"
+
+/* separates the members of a group, commas separate its settings */
+#define GROUP_MEMBER_SEPARATOR '+'
+
+/* batteries with their own levels, messages and state */
+typedef struct Group {
+  char *spec; /* as given, to tell whether a reload changed it */
+  char *name;
+  char **members;
+  int member_count;
+  int *indexes; /* of the members in the monitored batteries */
+
+  int warning;
+  int critical;
+  int danger;
+  int full;
+  Template *warningmsg;
+  Template *criticalmsg;
+  Template *fullmsg;
+  char *dangercmd;
+
+  char state;
+  int level;
+} Group;
+
+int parse_group(char *spec, Group **groups, int count);
+bool groups_init(Group *groups, int count, char **names, int name_count);
+void groups_free(Group *groups, int count);
+void groups_update(BatteryState *battery);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "battery.h"
+#include "json.h"
+
+static char *format_names[] = { "none", "json", "waybar", "i3bar" };
+
+static int format = JSON_NONE;
+static int output_fd = -1;
+
+/* the line is built in one buffer and compared with the last one written */
+static char line[JSON_LINE_LENGTH];
+static char last_line[JSON_LINE_LENGTH];
+static size_t length;
+static size_t last_length = 0;
+
+static void append(const char *fmt, ...)
+{
+  va_list args;
+
+  if (length >= sizeof(line))
+    return;
+  va_start(args, fmt);
+  length += vsnprintf(line + length, sizeof(line) - length, fmt, args);
+  va_end(args);
+}
+
+/* battery names come from sysfs or the user, keep them valid JSON */
+static void append_escaped(char *s)
+{
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      append("\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      append("\\u%04x", *s);
+    else
+      append("%c", *s);
+  }
+}
+
+static void append_string(char *s)
+{
+  append("\"");
+  append_escaped(s);
+  append("\"");
+}
+
+/* a battery that does not fit is left out whole and the line is cut back
+ * to where it started, leaving room to close the object */
+static bool fits(size_t start)
+{
+  if (length + JSON_RESERVE < sizeof(line))
+    return true;
+  length = start;
+  line[length] = '\0';
+  return false;
+}
+
+/* the estimate moves every check, only whole minutes count as a change,
+ * as in the other formats */
+static void append_time(BatteryState *battery)
+{
+  if (battery->time_to_empty < 0)
+    append("null");
+  else
+    append("%d", battery->time_to_empty / 60 * 60);
+}
+
+static void format_plain(BatteryState *battery)
+{
+  size_t start;
+  double rate = battery->energy_full ? 360000 * battery->rate / battery->energy_full : 0;
+
+  append("{\"level\":%d,\"state\":\"%s\",\"discharging\":%s,\"time_to_empty\":",
+      battery->level, state_name(battery->state), battery->discharging ? "true" : "false");
+  append_time(battery);
+  append(",\"rate\":%.1f,\"batteries\":[", rate);
+  for (int i = 0; i < battery->count; i++) {
+    start = length;
+    append(i ? ",{\"name\":" : "{\"name\":");
+    append_string(battery->names[i]);
+    append(",\"level\":%d,\"status\":\"%s\"}", battery_level(battery, i),
+        status_name(battery->statuses[i]));
+    if (!fits(start))
+      break;
+  }
+  append("]}\n");
+}
+
+static void format_waybar(BatteryState *battery)
+{
+  size_t start;
+
+  append("{\"text\":\"%d%%\",\"alt\":\"%s\",\"class\":\"%s\",\"percentage\":%d,\"tooltip\":\"",
+      battery->level, state_name(battery->state), state_name(battery->state), battery->level);
+  if (battery->time_to_empty >= 0)
+    append("%d:%02d remaining\\n", battery->time_to_empty / 3600, battery->time_to_empty / 60 % 60);
+  for (int i = 0; i < battery->count; i++) {
+    start = length;
+    append(i ? "\\n" : "");
+    append_escaped(battery->names[i]);
+    append(": %d%% %s", battery_level(battery, i), status_name(battery->statuses[i]));
+    if (!fits(start))
+      break;
+  }
+  append("\"}\n");
+}
+
+static void format_i3bar(BatteryState *battery)
+{
+  char *color = NULL;
+
+  if (battery->state == STATE_WARNING)
+    color = "#FFFF00";
+  else if (battery->state == STATE_CRITICAL || battery->state == STATE_DANGER)
+    color = "#FF0000";
+
+  append("[{\"name\":\"battery\",\"instance\":\"%s\",\"full_text\":\"%d%%",
+      state_name(battery->state), battery->level);
+  if (battery->time_to_empty >= 0)
+    append(" %d:%02d", battery->time_to_empty / 3600, battery->time_to_empty / 60 % 60);
+  append("\"");
+  if (color)
+    append(",\"color\":\"%s\",\"urgent\":%s", color, battery->state == STATE_WARNING ? "false" : "true");
+  append("}],\n");
+}
+
+int json_format(char *name)
+{
+  for (int i = JSON_PLAIN; i <= JSON_I3BAR; i++)
+    if (strcmp(name, format_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+void json_init(int output_format)
+{
+  static const char i3bar_header[] = "{\"version\":1}\n[\n";
+
+  format = output_format;
+  if (format == JSON_NONE)
+    return;
+
+  /* the stream gets stdout to itself, everything else printed goes to stderr */
+  output_fd = dup(STDOUT_FILENO);
+  if (output_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+    err(EXIT_FAILURE, "Could not set up output stream");
+
+  if (format == JSON_I3BAR && write(output_fd, i3bar_header, sizeof(i3bar_header) - 1) < 0)
+    err(EXIT_FAILURE, "Could not write output stream");
+}
+
+void json_publish(BatteryState *battery)
+{
+  if (format == JSON_NONE)
+    return;
+
+  length = 0;
+  if (format == JSON_PLAIN)
+    format_plain(battery);
+  else if (format == JSON_WAYBAR)
+    format_waybar(battery);
+  else
+    format_i3bar(battery);
+
+  if (length == last_length && memcmp(line, last_line, length) == 0)
+    return;
+  if (write(output_fd, line, length) < 0)
+    err(EXIT_FAILURE, "Could not write output stream");
+  memcpy(last_line, line, length);
+  last_length = length;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include "battery.h"
+
+/* output formats */
+#define JSON_NONE 0
+#define JSON_PLAIN 1
+#define JSON_WAYBAR 2
+#define JSON_I3BAR 3
+
+/* longest line written, batteries that do not fit are left out whole and
+ * the reserve is kept to close the line */
+#define JSON_LINE_LENGTH 4096
+#define JSON_RESERVE 8
+
+int json_format(char *name);
+void json_init(int format);
+void json_publish(BatteryState *battery);
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef NO_DBUS
+#include <gio/gio.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "logind.h"
+
+/* action names as accepted on the command line, indexed by action */
+static char *action_names[] = {
+  "none", "suspend", "hibernate", "hybrid-sleep", "poweroff"
+};
+
+#ifndef NO_DBUS
+static GDBusConnection *bus = NULL;
+
+/* logind manager methods, indexed by action */
+static char *action_methods[] = {
+  NULL, "Suspend", "Hibernate", "HybridSleep", "PowerOff"
+};
+#endif
+
+int logind_action(char *name)
+{
+  for (int i = ACTION_NONE; i <= ACTION_POWEROFF; i++)
+    if (strcmp(name, action_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+char* logind_action_name(int action)
+{
+  return action_names[action];
+}
+
+#ifndef NO_DBUS
+bool logind_init()
+{
+  GError *error = NULL;
+
+  if (bus)
+    return true;
+
+  bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+  if (bus == NULL) {
+    warnx("Could not connect to system bus: %s", error->message);
+    g_error_free(error);
+    return false;
+  }
+  return true;
+}
+
+bool logind_can(int action)
+{
+  char method[32];
+  const char *answer;
+  GVariant *reply;
+  GError *error = NULL;
+  bool can;
+
+  if (action == ACTION_NONE)
+    return true;
+  if (!logind_init())
+    return false;
+
+  snprintf(method, sizeof(method), "Can%s", action_methods[action]);
+  reply = g_dbus_connection_call_sync(bus, LOGIND_BUS_NAME, LOGIND_OBJECT_PATH,
+      LOGIND_MANAGER_INTERFACE, method, NULL, G_VARIANT_TYPE("(s)"),
+      G_DBUS_CALL_FLAGS_NONE, LOGIND_TIMEOUT, NULL, &error);
+  if (reply == NULL) {
+    warnx("%s failed: %s", method, error->message);
+    g_error_free(error);
+    return false;
+  }
+
+  /* "challenge" is not enough, actions are requested non-interactively */
+  g_variant_get(reply, "(&s)", &answer);
+  can = strcmp(answer, "yes") == 0;
+  if (!can)
+    warnx("%s returned \"%s\"", method, answer);
+  g_variant_unref(reply);
+  return can;
+}
+
+bool logind_run(int action)
+{
+  GVariant *reply;
+  GError *error = NULL;
+
+  if (action == ACTION_NONE)
+    return true;
+  if (!logind_init())
+    return false;
+
+  /* non-interactive: there is nobody to answer an authentication prompt */
+  reply = g_dbus_connection_call_sync(bus, LOGIND_BUS_NAME, LOGIND_OBJECT_PATH,
+      LOGIND_MANAGER_INTERFACE, action_methods[action], g_variant_new("(b)", FALSE),
+      NULL, G_DBUS_CALL_FLAGS_NONE, LOGIND_TIMEOUT, NULL, &error);
+  if (reply == NULL) {
+    warnx("%s failed: %s", action_methods[action], error->message);
+    g_error_free(error);
+    return false;
+  }
+  g_variant_unref(reply);
+  return true;
+}
+
+void logind_uninit()
+{
+  if (bus) {
+    g_object_unref(bus);
+    bus = NULL;
+  }
+}
+#else
+/* without D-Bus, systemctl asks logind on our behalf */
+bool logind_init()
+{
+  return true;
+}
+
+bool logind_can(int action)
+{
+  return true;
+}
+
+bool logind_run(int action)
+{
+  pid_t pid;
+  int status;
+
+  if (action == ACTION_NONE)
+    return true;
+
+  /* systemctl verbs match the action names */
+  switch (pid = fork()) {
+  case -1:
+    warn("Could not run systemctl");
+    return false;
+  case 0:
+    execlp(LOGIND_SYSTEMCTL, LOGIND_SYSTEMCTL, "--no-ask-password",
+        action_names[action], (char *) NULL);
+    _exit(127);
+  }
+
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    warnx("%s %s failed", LOGIND_SYSTEMCTL, action_names[action]);
+    return false;
+  }
+  return true;
+}
+
+void logind_uninit()
+{
+}
+#endif
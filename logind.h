@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef LOGIND_H
+#define LOGIND_H
+
+#include <stdbool.h>
+
+/* built-in danger actions */
+#define ACTION_NONE 0
+#define ACTION_SUSPEND 1
+#define ACTION_HIBERNATE 2
+#define ACTION_HYBRID_SLEEP 3
+#define ACTION_POWEROFF 4
+
+/* logind D-Bus names */
+#define LOGIND_BUS_NAME "org.freedesktop.login1"
+#define LOGIND_OBJECT_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+
+/* milliseconds to wait for a logind reply */
+#define LOGIND_TIMEOUT 5000
+
+/* requests logind actions when built without D-Bus */
+#define LOGIND_SYSTEMCTL "systemctl"
+
+int logind_action(char *name);
+char* logind_action_name(int action);
+bool logind_init();
+bool logind_can(int action);
+bool logind_run(int action);
+void logind_uninit();
+
+#endif
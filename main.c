@@ -22,12 +22,30 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include "alert.h"
+#include "bank.h"
 #include "battery.h"
+#include "danger.h"
+#include "dbus.h"
+#include "event.h"
+#include "estimate.h"
+#include "freeze.h"
+#include "group.h"
+#include "json.h"
+#include "logind.h"
 #include "main.h"
+#include "metrics.h"
 #include "notify.h"
 #include "options.h"
-#include "fullscreen.h"
+#include "powersave.h"
+#include "prepare.h"
+#include "reload.h"
+#include "rules.h"
+#include "server.h"
+#include "shm.h"
+#include "uevent.h"
 
 void print_version()
 {
@@ -45,42 +63,199 @@ Options:\n\
     -v             print program version information\n\
     -b             run as background daemon\n\
     -o             check battery once and exit\n\
+    -q             print battery level and state once and exit, without\n\
+                   notifications\n\
+    -s             publish battery state in shared memory\n\
+    -L             serve battery state to %sctl clients\n\
+    -B             publish battery state on the session D-Bus\n\
+    -j FORMAT      write a line to stdout whenever the state changes\n\
+                   (json, waybar or i3bar)\n\
+    -x ADDRESS     serve Prometheus metrics on ADDRESS, a localhost\n\
+                   port or a Unix socket path\n\
+    -k FILE        write Prometheus metrics to FILE after each check\n\
     -i             ignore missing battery errors\n\
     -e             cause notifications to expire\n\
     -N             disable desktop notifications\n\
-    -w LEVEL       battery warning LEVEL\n\
+    -w LEVEL       battery warning LEVEL, or MINUTESm of predicted\n\
+                   runtime - may be given once in each form\n\
                    (default: 15)\n\
-    -c LEVEL       critical battery LEVEL\n\
+    -c LEVEL       critical battery LEVEL or MINUTESm\n\
                    (default: 5)\n\
-    -d LEVEL       battery danger LEVEL\n\
+    -d LEVEL       battery danger LEVEL or MINUTESm\n\
                    (default: 2)\n\
     -f LEVEL       full battery LEVEL\n\
                    (default: disabled)\n\
     -p             show message when battery begins charging/discharging\n\
+    -H             prepare for hibernation at critical and danger levels\n\
     -W MESSAGE     show MESSAGE when battery is at warning level\n\
     -C MESSAGE     show MESSAGE when battery is at critical level\n\
     -D COMMAND     run COMMAND when battery is at danger level\n\
+    -A ACTIONS     escalate through logind ACTIONS at danger level,\n\
+                   separated by commas, each with optional :SECONDS\n\
+                   deadline (suspend, hibernate, hybrid-sleep, poweroff,\n\
+                   command or none - ex: hibernate:120,suspend,poweroff)\n\
     -F MESSAGE     show MESSAGE when battery is full\n\
     -P MESSAGE     battery charging MESSAGE\n\
     -U MESSAGE     battery discharging MESSAGE\n\
-    -M COMMAND     send each message using COMMAND\n\
+    -M COMMAND     send each message using COMMAND, {message} or %%s is\n\
+                   replaced by the message, a second %%s by the level\n\
+                   messages and commands may contain {level}, {state},\n\
+                   {minutes}, {time}, {rate}, {timestamp}, {level:NAME}\n\
+                   and {status:NAME} of battery NAME\n\
     -n NAME        use battery NAME - multiple batteries separated by commas\n\
                    (default: BAT0)\n\
     -m SECONDS     minimum number of SECONDS to wait between battery checks\n\
                    0 SECONDS disables polling and waits for USR1 signal\n\
                    Prefixing with a + will always check at SECONDS interval\n\
                    (default: 60)\n\
+    -u             check only the batteries the kernel reports as changed,\n\
+                   with a full check at each interval\n\
     -a NAME        app NAME used in desktop notifications\n\
                    (default: %s)\n\
     -I ICON        display specified ICON in notifications\n\
-", PROGNAME, PROGNAME);
+", PROGNAME, PROGNAME, PROGNAME);
+  printf("\
+    -Z CGROUPS     freeze CGROUPS at critical level until charging or\n\
+                   recovered - multiple cgroups separated by commas\n\
+    -S SETTINGS    apply power saving SETTINGS at a battery level and\n\
+                   restore them when charging, may be given repeatedly\n\
+                   (ex: level=critical,profile=low-power,epp=power,\n\
+                   backlight=30,noturbo)\n\
+    -O SPREAD      bank mode: alert when a battery is more than SPREAD\n\
+                   points away from the level of all batteries\n\
+    -g SETTINGS    watch a group of batteries with its own levels and\n\
+                   messages, may be given repeatedly (ex: name=ups,\n\
+                   batteries=UPS0+UPS1,warning=50,critical=30,\n\
+                   danger=10,dangercmd=shutdown now)\n\
+    -r RULE        take an action when a threshold is crossed, may be\n\
+                   given repeatedly - THRESHOLD:ACTION[:ARGUMENT] with\n\
+                   LEVEL%%, MINUTESm left or >LEVEL%% while charging, and\n\
+                   notify, urgent, command, fullscreen or a logind action\n\
+                   (ex: 25%%:command:powerprofilesctl set power-saver)\n\
+    -R ROOT        prefix system paths with ROOT\n\
+");
 }
 
-void cleanup()
+/* a level given in minutes applies once the drain rate estimate is stable,
+ * the percent level applies always */
+static bool reached(int level, int minutes, BatteryState *battery)
+{
+  if (level && battery->level <= level)
+    return true;
+  return minutes && estimate_stable() && battery->time_to_empty >= 0
+    && battery->time_to_empty <= minutes * 60;
+}
+
+/* seconds until the estimate reaches the next level given in minutes */
+static unsigned int time_wait(Config *config, BatteryState *battery, unsigned int duration)
+{
+  int minutes[] = { config->warning_minutes, config->critical_minutes, config->danger_minutes };
+  bool timed = false;
+  int wait;
+
+  for (int i = 0; i < 3; i++) {
+    if (minutes[i] == 0)
+      continue;
+    timed = true;
+    wait = battery->time_to_empty - minutes[i] * 60;
+    if (estimate_stable() && wait > 0 && (unsigned int)wait < duration)
+      duration = wait;
+  }
+  if (!timed)
+    return duration;
+
+  /* keep sampling often enough for the estimate to settle and stay fresh */
+  if (!estimate_stable() && config->multiplier && (unsigned int)config->multiplier < duration)
+    duration = config->multiplier;
+  if (duration > ESTIMATE_WINDOW / ESTIMATE_SAMPLES)
+    duration = ESTIMATE_WINDOW / ESTIMATE_SAMPLES;
+  return duration;
+}
+
+/* classify the battery like the main loop would, without acting on it */
+static char query_state(Config *config, BatteryState *battery)
 {
-  if (notify_is_initted()) {
-    notify_uninit();
+  if (!battery->discharging) {
+    if (config->full && (battery->level >= config->full || battery->full))
+      return STATE_FULL;
+    return STATE_AC;
   }
+  if (reached(config->danger, config->danger_minutes, battery))
+    return STATE_DANGER;
+  if (reached(config->critical, config->critical_minutes, battery))
+    return STATE_CRITICAL;
+  if (reached(config->warning, config->warning_minutes, battery))
+    return STATE_WARNING;
+  return STATE_DISCHARGING;
+}
+
+/* options from the config file, if there is one, then the command line,
+ * returns the file used */
+static char *load_options(int argc, char *argv[], Config *config)
+{
+  char *config_file = find_config_file();
+  char **conf_argv;
+  int conf_argc = 0;
+
+  if (config_file) {
+    conf_argv = read_config_file(config_file, &conf_argc, NULL);
+    parse_args(conf_argc, conf_argv, config);
+    free_args(conf_argc, conf_argv);
+  }
+  parse_args(argc, argv, config);
+  return config_file;
+}
+
+/* fast path for scripts: no notifications, X11 or D-Bus */
+static int query(int argc, char *argv[], Config *config)
+{
+  BatteryState battery = { 0 };
+
+  free(load_options(argc, argv, config));
+  validate_options(config);
+
+  set_battery_root(config->root);
+  if (config->battery_count > 0) {
+    if (validate_batteries(config->battery_names, config->battery_count) >= 0 && config->battery_required)
+      errx(EXIT_FAILURE, "Battery not found");
+  } else {
+    config->battery_count = find_batteries(&config->battery_names);
+  }
+  if (config->battery_count < 1)
+    errx(EXIT_FAILURE, "No batteries found");
+
+  battery.names = config->battery_names;
+  battery.count = config->battery_count;
+  update_battery_state(&battery, config->battery_required);
+  printf("level=%d state=%s\n", battery.level, state_name(query_state(config, &battery)));
+  return EXIT_SUCCESS;
+}
+
+/* children checking a reloaded configuration exit through here too */
+static pid_t main_pid;
+
+/* includes time spent suspended, so a full check follows a resume */
+static time_t boot_seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec;
+}
+
+void cleanup()
+{
+  if (getpid() != main_pid)
+    return;
+  notification_uninit();
+  alert_close();
+  logind_uninit();
+  thaw_cgroups(NULL);
+  powersave_restore();
+  shm_uninit();
+  server_uninit();
+  metrics_uninit();
+  uevent_uninit();
 }
 
 void signal_handler()
@@ -91,56 +266,37 @@ void signal_handler()
 int main(int argc, char *argv[])
 {
   unsigned int duration;
+  int deadline;
+  int next_rule;
+  int sig;
+  double tick_start;
+  double fullscreen_start;
   bool previous_discharging_status;
+  bool changes_only = false;
+  time_t verify_due = 0;
+  time_t remaining;
   sigset_t sigs;
   struct timespec timeout = { .tv_sec = 0 };
   int bat_index;
-  BatteryState battery;
+  BatteryState battery = { 0 };
   char *config_file = NULL;
-  int conf_argc = 0;
-  char **conf_argv;
 
-  Config config = {
-    .daemonize = false,
-    .run_once = false,
-    .battery_required = true,
-    .show_notifications = true,
-    .show_charging_msg = false,
-    .help = false,
-    .version = false,
-    .battery_names = NULL,
-    .battery_count = 0,
-    .multiplier = 60,
-    .fixed = false,
-    .warning = 15,
-    .critical = 5,
-    .danger = 2,
-    .full = 0,
-    .warningmsg = "Battery is low",
-    .criticalmsg = "Battery is critically low",
-    .fullmsg = "Battery is full",
-    .chargingmsg = "Battery is charging",
-    .dischargingmsg = "Battery is discharging",
-    .dangercmd = "",
-    .msgcmd = "",
-    .appname = PROGNAME,
-    .icon = NULL,
-    .notification_expires = NOTIFY_EXPIRES_NEVER
-  };
+  Config config;
+
+  default_options(&config);
+  if (query_requested(argc, argv))
+    return query(argc, argv, &config);
 
   sigemptyset(&sigs);
   sigaddset(&sigs, SIGUSR1);
+  sigaddset(&sigs, SIGHUP);
+  main_pid = getpid();
   atexit(cleanup);
   signal(SIGTERM, signal_handler);
   signal(SIGINT, signal_handler);
   sigprocmask(SIG_BLOCK, &sigs, NULL);
 
-  config_file = find_config_file();
-  if (config_file) {
-    conf_argv = read_config_file(config_file, &conf_argc, NULL);
-    parse_args(conf_argc, conf_argv, &config);
-  }
-  parse_args(argc, argv, &config);
+  config_file = load_options(argc, argv, &config);
 
   if (config.help) {
     print_help();
@@ -151,6 +307,7 @@ int main(int argc, char *argv[])
   }
 
   validate_options(&config);
+  json_init(config.output_format);
   if (config_file)
     printf("Using config file: %s\n", config_file);
 
@@ -158,6 +315,14 @@ int main(int argc, char *argv[])
     notification_init(config.appname, config.icon, config.notification_expires);
   set_message_command(config.msgcmd);
 
+  for (int i = 0; i < config.dangerstep_count; i++)
+    if (config.dangersteps[i].action != DANGER_COMMAND && !logind_can(config.dangersteps[i].action))
+      warnx("Danger action %s may not be permitted", logind_action_name(config.dangersteps[i].action));
+  for (int i = 0; i < config.rule_count; i++)
+    if (config.rules[i].action > ACTION_NONE && !logind_can(config.rules[i].action))
+      warnx("Rule action %s may not be permitted", logind_action_name(config.rules[i].action));
+
+  set_battery_root(config.root);
   if (config.battery_count > 0) {
     bat_index = validate_batteries(config.battery_names, config.battery_count);
     if (config.battery_required && bat_index >= 0)
@@ -176,33 +341,71 @@ int main(int argc, char *argv[])
   if (config.daemonize && daemon(1, 1) < 0) {
     err(EXIT_FAILURE, "Failed to daemonize");
   }
+  main_pid = getpid();
+
+  event_init(&sigs);
+  reload_init(argc, argv, config_file);
+  free(config_file);
+  if (config.shared_state && !shm_init())
+    exit(EXIT_FAILURE);
+  if (config.serve_clients && !server_init())
+    exit(EXIT_FAILURE);
+  if (!metrics_init(config.metrics_address, config.metrics_file))
+    exit(EXIT_FAILURE);
+
+  freeze_init(config.root, config.freeze_cgroups, config.freeze_count);
+  powersave_init(config.root, config.powersave, config.powersave_count);
+  prepare_init(config.root);
+  rules_init(config.rules, config.rule_count);
 
   battery.names = config.battery_names;
   battery.count = config.battery_count;
   update_battery_state(&battery, config.battery_required);
+  if (!groups_init(config.groups, config.group_count, config.battery_names, config.battery_count))
+    exit(EXIT_FAILURE);
+  bank_init(config.bank_spread, config.battery_count);
+  if (config.serve_dbus)
+    dbus_init(&battery);
+  if (config.uevents)
+    uevent_init(&battery);
 
   for(;;) {
+    tick_start = metrics_start();
     previous_discharging_status = battery.discharging;
-    update_battery_state(&battery, config.battery_required);
+    if (changes_only)
+      update_changed_batteries(&battery, config.battery_required);
+    else
+      update_battery_state(&battery, config.battery_required);
+    estimate_update(&battery);
     duration = config.multiplier;
 
     if (battery.discharging) { /* discharging */
-      if (config.danger && battery.level <= config.danger) {
+      if (reached(config.danger, config.danger_minutes, &battery)) {
         if (battery.state != STATE_DANGER) {
           battery.state = STATE_DANGER;
-          if (config.dangercmd[0] != '\0')
-            if (system(config.dangercmd) == -1) { /* Ignore command errors... */ }
-          fullscreen();
+          /* the image only shrinks if this is done before any step runs */
+          if (config.prepare_hibernate) {
+            prepare_hibernate();
+            prepare_wait(PREPARE_TIMEOUT);
+          }
+          danger_start(config.dangercmd, config.dangersteps, config.dangerstep_count, &battery);
+          alert_update(&battery);
+          fullscreen_start = metrics_start();
+          alert_show();
+          metrics_observe(METRIC_FULLSCREEN, fullscreen_start);
         }
 
-      } else if (config.critical && battery.level <= config.critical) {
+      } else if (reached(config.critical, config.critical_minutes, &battery)) {
         if (battery.state != STATE_CRITICAL) {
           battery.state = STATE_CRITICAL;
           notify(config.criticalmsg, NOTIFY_URGENCY_CRITICAL, battery);
+          if (config.prepare_hibernate)
+            prepare_writeback();
+          alert_prepare();
         }
 
-      } else if (config.warning && battery.level <= config.warning) {
-        if (!config.fixed)
+      } else if (reached(config.warning, config.warning_minutes, &battery)) {
+        if (!config.fixed && battery.level > config.critical)
           duration = (battery.level - config.critical) * config.multiplier;
 
         if (battery.state != STATE_WARNING) {
@@ -217,7 +420,7 @@ int main(int argc, char *argv[])
           close_notification();
         }
         battery.state = STATE_DISCHARGING;
-        if (!config.fixed)
+        if (!config.fixed && battery.level > config.warning)
           duration = (battery.level - config.warning) * config.multiplier;
       }
 
@@ -236,14 +439,79 @@ int main(int argc, char *argv[])
       }
     }
 
-    if (config.multiplier == 0) {
-      sigwaitinfo(&sigs, NULL);
+    /* groups and the bank share the samples read above */
+    groups_update(&battery);
+    bank_update(&battery);
+
+    /* check again in time for the next level given in minutes */
+    if (battery.discharging && !config.fixed)
+      duration = time_wait(&config, &battery, duration);
+
+    /* check again in time for the next level rule, like for the levels */
+    rules_evaluate(&battery);
+    next_rule = rules_next_level();
+    if (battery.discharging && !config.fixed && next_rule >= 0
+        && (unsigned int)(battery.level - next_rule) * config.multiplier < duration)
+      duration = (battery.level - next_rule) * config.multiplier;
+
+    /* the alert only stays up in danger or while a fullscreen rule holds,
+     * and ready to be shown in critical */
+    if (battery.state == STATE_CRITICAL && !rules_fullscreen())
+      alert_hide();
+    else if (battery.state != STATE_DANGER && !rules_fullscreen())
+      alert_close();
+
+    shm_publish(&battery);
+    server_publish(&battery);
+    json_publish(&battery);
+    if (config.serve_dbus)
+      dbus_publish(&battery);
+
+    if (battery.state == STATE_CRITICAL || battery.state == STATE_DANGER)
+      freeze_cgroups(&battery);
+    else
+      thaw_cgroups(&battery);
+
+    if (battery.discharging)
+      powersave_apply(battery.state);
+    else
+      powersave_restore();
+
+    metrics_observe(METRIC_TICK, tick_start);
+    metrics_write();
+
+    /* wake up in time to verify the current danger step */
+    deadline = danger_update(&battery);
+    if (battery.state == STATE_DANGER || rules_fullscreen())
+      alert_update(&battery);
+    if (deadline > 0 && (config.multiplier == 0 || (unsigned int)deadline < duration))
+      duration = deadline;
+
+    if (config.run_once) break;
+
+    /* uevent checks only read what changed, the next full check stays
+     * when the last full check scheduled it, to catch a lost event */
+    if (config.uevents) {
+      if (!changes_only)
+        verify_due = boot_seconds()
+          + (config.multiplier == 0 && deadline == 0 ? UEVENT_VERIFY_INTERVAL : (time_t)duration);
+      remaining = verify_due - boot_seconds();
+      if (remaining < 0)
+        remaining = 0;
+      if ((config.multiplier == 0 && deadline == 0) || (time_t)duration > remaining)
+        duration = remaining;
+    }
+
+    if (config.multiplier == 0 && deadline == 0 && !config.uevents) {
+      sig = event_wait(NULL);
     } else {
       timeout.tv_sec = duration;
-      sigtimedwait(&sigs, NULL, &timeout);
+      sig = event_wait(&timeout);
     }
-
-    if (config.run_once) break;
+    changes_only = config.uevents && sig == SIGUSR1 && battery_changes_pending()
+      && boot_seconds() < verify_due;
+    if (sig == SIGHUP)
+      reload_config(&config);
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "event.h"
+#include "main.h"
+#include "metrics.h"
+
+typedef struct Histogram {
+  char *name;
+  char *help;
+  char *labels;
+  double sum;
+  unsigned long count;
+  unsigned long buckets[METRICS_BUCKETS];
+} Histogram;
+
+/* a scrape connection, answered without blocking and closed on a deadline */
+typedef struct Scrape {
+  bool open;
+  int fd;
+  int timer_fd;
+  char out[METRICS_HEADER_LENGTH + METRICS_TEXT_LENGTH];
+  size_t out_length;
+  size_t out_sent;
+} Scrape;
+
+typedef struct Counter {
+  char *name;
+  char *help;
+  unsigned long value;
+} Counter;
+
+/* histograms sharing a name must be adjacent, HELP is written once per name */
+static Histogram histograms[METRIC_COUNT] = {
+  [METRIC_READ_STATUS] = { "sysfs_read_seconds", "Time to read a battery attribute.", "attribute=\"status\"" },
+  [METRIC_READ_NOW] = { "sysfs_read_seconds", NULL, "attribute=\"now\"" },
+  [METRIC_READ_FULL] = { "sysfs_read_seconds", NULL, "attribute=\"full\"" },
+  [METRIC_TICK] = { "tick_seconds", "Time to check the battery and act on its state.", NULL },
+  [METRIC_NOTIFY] = { "notification_seconds", "Time to deliver a desktop notification.", NULL },
+  [METRIC_COMMAND] = { "command_seconds", "Run time of message and danger commands.", NULL },
+  [METRIC_FULLSCREEN] = { "fullscreen_seconds", "Time to show the fullscreen alert.", NULL }
+};
+
+static Counter counters[COUNTER_COUNT] = {
+  [COUNTER_READ_ERRORS] = { "sysfs_read_errors_total", "Battery attributes that could not be read." },
+  [COUNTER_UEVENT_MISSED] = { "uevent_missed_total", "Battery changes found by a full check without a uevent." }
+};
+
+static const double bounds[METRICS_BUCKETS] = METRICS_BUCKET_BOUNDS;
+
+static bool enabled = false;
+static char *textfile_path = NULL;
+static char *textfile_temp = NULL;
+static char text[METRICS_TEXT_LENGTH];
+
+static int listen_fd = -1;
+static char *socket_path = NULL;
+
+/* fixed slots, so scrapes never allocate */
+static Scrape scrapes[METRICS_MAX_SCRAPES];
+
+double metrics_start()
+{
+  struct timespec ts;
+
+  if (!enabled)
+    return 0;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void metrics_observe(int metric, double start)
+{
+  Histogram *histogram = &histograms[metric];
+  double elapsed;
+  int i;
+
+  if (start == 0)
+    return;
+  elapsed = metrics_start() - start;
+
+  for (i = 0; i < METRICS_BUCKETS && elapsed > bounds[i]; i++);
+  if (i < METRICS_BUCKETS)
+    histogram->buckets[i]++;
+  histogram->sum += elapsed;
+  histogram->count++;
+}
+
+void metrics_count(int counter)
+{
+  counters[counter].value++;
+}
+
+/* render the text exposition format into the static buffer */
+static size_t render()
+{
+  Histogram *h;
+  size_t length = 0;
+  unsigned long cumulative;
+  char *labels;
+  char *sep;
+
+#define APPEND(...) \
+  if (length < sizeof(text)) \
+    length += snprintf(text + length, sizeof(text) - length, __VA_ARGS__)
+
+  for (int m = 0; m < METRIC_COUNT; m++) {
+    h = &histograms[m];
+    labels = h->labels ? h->labels : "";
+    sep = h->labels ? "," : "";
+    if (h->help) {
+      APPEND("# HELP " PROGNAME "_%s %s\n", h->name, h->help);
+      APPEND("# TYPE " PROGNAME "_%s histogram\n", h->name);
+    }
+    cumulative = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+      cumulative += h->buckets[i];
+      APPEND(PROGNAME "_%s_bucket{%s%sle=\"%g\"} %lu\n", h->name, labels, sep, bounds[i], cumulative);
+    }
+    APPEND(PROGNAME "_%s_bucket{%s%sle=\"+Inf\"} %lu\n", h->name, labels, sep, h->count);
+    APPEND(PROGNAME "_%s_sum%s%s%s %.9f\n", h->name, *sep ? "{" : "", labels, *sep ? "}" : "", h->sum);
+    APPEND(PROGNAME "_%s_count%s%s%s %lu\n", h->name, *sep ? "{" : "", labels, *sep ? "}" : "", h->count);
+  }
+
+  for (int c = 0; c < COUNTER_COUNT; c++) {
+    APPEND("# HELP " PROGNAME "_%s %s\n", counters[c].name, counters[c].help);
+    APPEND("# TYPE " PROGNAME "_%s counter\n", counters[c].name);
+    APPEND(PROGNAME "_%s %lu\n", counters[c].name, counters[c].value);
+  }
+
+#undef APPEND
+  return length < sizeof(text) ? length : sizeof(text) - 1;
+}
+
+/* write to a temporary file and rename, so collectors never see half a file */
+void metrics_write()
+{
+  size_t length;
+  int fd;
+
+  if (textfile_path == NULL)
+    return;
+
+  length = render();
+  fd = open(textfile_temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    warn("Could not write %s", textfile_temp);
+    return;
+  }
+  if (write(fd, text, length) != (ssize_t)length || close(fd) < 0) {
+    warn("Could not write %s", textfile_temp);
+    unlink(textfile_temp);
+    return;
+  }
+  if (rename(textfile_temp, textfile_path) < 0)
+    warn("Could not rename %s", textfile_temp);
+}
+
+static void close_scrape(Scrape *scrape)
+{
+  event_remove(scrape->fd);
+  event_remove(scrape->timer_fd);
+  close(scrape->fd);
+  close(scrape->timer_fd);
+  scrape->open = false;
+}
+
+/* send what the socket takes, the rest once it is writable again */
+static void flush_scrape(Scrape *scrape)
+{
+  ssize_t sent;
+
+  while (scrape->out_sent < scrape->out_length) {
+    sent = send(scrape->fd, scrape->out + scrape->out_sent,
+        scrape->out_length - scrape->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      event_modify(scrape->fd, POLLOUT);
+      return;
+    }
+    if (sent <= 0)
+      break;
+    scrape->out_sent += sent;
+  }
+  close_scrape(scrape);
+}
+
+/* requests are tiny, the first read is answered and the connection closed
+ * once the answer is sent */
+static void http_event(int fd, short revents, void *data)
+{
+  Scrape *scrape = data;
+  char request[512];
+  ssize_t received;
+  size_t length;
+
+  if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    close_scrape(scrape);
+    return;
+  }
+  if (scrape->out_length > 0) {
+    flush_scrape(scrape);
+    return;
+  }
+  received = recv(fd, request, sizeof(request), MSG_DONTWAIT);
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  if (received <= 0) {
+    close_scrape(scrape);
+    return;
+  }
+
+  length = render();
+  scrape->out_length = snprintf(scrape->out, METRICS_HEADER_LENGTH,
+      "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", length);
+  memcpy(scrape->out + scrape->out_length, text, length);
+  scrape->out_length += length;
+  scrape->out_sent = 0;
+  flush_scrape(scrape);
+}
+
+/* the scrape did not finish in time */
+static void timeout_event(int fd, short revents, void *data)
+{
+  close_scrape(data);
+}
+
+static Scrape *free_scrape()
+{
+  for (int i = 0; i < METRICS_MAX_SCRAPES; i++)
+    if (!scrapes[i].open)
+      return &scrapes[i];
+  return NULL;
+}
+
+static void listen_event(int fd, short revents, void *data)
+{
+  struct itimerspec deadline = { .it_value = { .tv_sec = METRICS_TIMEOUT } };
+  Scrape *scrape;
+  int client_fd;
+  int timer_fd;
+
+  while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    scrape = free_scrape();
+    timer_fd = scrape ? timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) : -1;
+    if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &deadline, NULL) < 0) {
+      /* too many scrapes at once, or no timer to end this one */
+      if (timer_fd >= 0)
+        close(timer_fd);
+      close(client_fd);
+      continue;
+    }
+    *scrape = (Scrape){ .open = true, .fd = client_fd, .timer_fd = timer_fd };
+    event_add(client_fd, POLLIN, http_event, scrape);
+    event_add(timer_fd, POLLIN, timeout_event, scrape);
+  }
+}
+
+static bool listen_failed()
+{
+  if (listen_fd >= 0)
+    close(listen_fd);
+  if (socket_path)
+    unlink(socket_path);
+  socket_path = NULL;
+  listen_fd = -1;
+  return false;
+}
+
+static bool listen_http(char *address)
+{
+  struct sockaddr_un unix_address = { .sun_family = AF_UNIX };
+  struct sockaddr_in inet_address = { .sin_family = AF_INET };
+  int reuse = 1;
+
+  /* a path means a Unix socket, otherwise a port on localhost */
+  if (address[0] == '/') {
+    if (strlen(address) >= sizeof(unix_address.sun_path)) {
+      warnx("Socket path is too long");
+      return false;
+    }
+    strcpy(unix_address.sun_path, address);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(address);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&unix_address, sizeof(unix_address)) < 0) {
+      warn("Could not bind %s", address);
+      return listen_failed();
+    }
+    socket_path = address;
+  } else {
+    /* checked to be a port by validate_options */
+    inet_address.sin_port = htons(strtoul(address, NULL, 10));
+    inet_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd >= 0)
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&inet_address, sizeof(inet_address)) < 0) {
+      warn("Could not bind port %s", address);
+      return listen_failed();
+    }
+  }
+
+  if (listen(listen_fd, SOMAXCONN) < 0) {
+    warn("Could not listen for metrics requests");
+    return listen_failed();
+  }
+  event_add(listen_fd, POLLIN, listen_event, NULL);
+  return true;
+}
+
+/* false if the endpoint cannot be served, a reload keeps running without it */
+bool metrics_init(char *address, char *textfile)
+{
+  enabled = address[0] != '\0' || textfile[0] != '\0';
+
+  /* may be called again on reload, histograms are kept */
+  textfile_path = NULL;
+  free(textfile_temp);
+  textfile_temp = NULL;
+  if (textfile[0] != '\0') {
+    textfile_path = textfile;
+    textfile_temp = malloc(strlen(textfile) + strlen(".tmp") + 1);
+    if (textfile_temp == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    strcpy(textfile_temp, textfile);
+    strcat(textfile_temp, ".tmp");
+  }
+
+  if (address[0] != '\0')
+    return listen_http(address);
+  return true;
+}
+
+void metrics_uninit()
+{
+  for (int i = 0; i < METRICS_MAX_SCRAPES; i++)
+    if (scrapes[i].open)
+      close_scrape(&scrapes[i]);
+  if (listen_fd < 0)
+    return;
+  event_remove(listen_fd);
+  close(listen_fd);
+  if (socket_path)
+    unlink(socket_path);
+  socket_path = NULL;
+  listen_fd = -1;
+}
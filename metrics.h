@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+
+/* histograms */
+#define METRIC_READ_STATUS 0
+#define METRIC_READ_NOW 1
+#define METRIC_READ_FULL 2
+#define METRIC_TICK 3
+#define METRIC_NOTIFY 4
+#define METRIC_COMMAND 5
+#define METRIC_FULLSCREEN 6
+#define METRIC_COUNT 7
+
+/* counters */
+#define COUNTER_READ_ERRORS 0
+#define COUNTER_UEVENT_MISSED 1
+#define COUNTER_COUNT 2
+
+/* upper bounds of the histogram buckets in seconds, +Inf is implied */
+#define METRICS_BUCKET_BOUNDS { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5 }
+#define METRICS_BUCKETS 15
+
+/* size of the rendered text exposition and the HTTP header before it */
+#define METRICS_TEXT_LENGTH 16384
+#define METRICS_HEADER_LENGTH 128
+
+/* scrapes served at once, and seconds each may take from connect to close */
+#define METRICS_MAX_SCRAPES 4
+#define METRICS_TIMEOUT 5
+
+bool metrics_init(char *address, char *textfile);
+double metrics_start();
+void metrics_observe(int metric, double start);
+void metrics_count(int counter);
+void metrics_write();
+void metrics_uninit();
+
+#endif
@@ -5,55 +5,97 @@
 #define _DEFAULT_SOURCE
 #include <err.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "battery.h"
+#include "metrics.h"
 #include "notify.h"
 
+#ifndef NO_NOTIFY
 static NotifyNotification *notification = NULL;
 static char *notification_icon = NULL;
+#else
+static bool journal = false;
+#endif
 
-static char *msgcmd = NULL;
-static char *msgcmdbuf = NULL;
+static Template *msgcmd = NULL;
+
+/* rendered message and command, sized once */
+static char message[TEMPLATE_LENGTH];
+static char command[TEMPLATE_LENGTH];
 
 void notification_init(char* appname, char *icon, int expires)
 {
+#ifndef NO_NOTIFY
   notification_icon = icon;
   if (!notify_init(appname))
     err(EXIT_FAILURE, "Failed to initialize notifications");
   notification = notify_notification_new("", NULL, icon);
   notify_notification_set_timeout(notification, expires);
+#else
+  journal = true;
+#endif
+}
+
+void notification_uninit()
+{
+#ifndef NO_NOTIFY
+  if (notification) {
+    g_object_unref(notification);
+    notification = NULL;
+  }
+  if (notify_is_initted())
+    notify_uninit();
+#else
+  journal = false;
+#endif
 }
 
-void set_message_command(char *command)
+void set_message_command(Template *command)
 {
   msgcmd = command;
 }
 
-void notify(char *msg, NotifyUrgency urgency, BatteryState battery)
+void notify(Template *msg, NotifyUrgency urgency, BatteryState battery)
 {
   char body[20];
-  char level[8];
-  size_t needed;
-
-  if (msgcmd[0] != '\0') {
-    snprintf(level, 8, "%d", battery.level);
-    needed = snprintf(NULL, 0, msgcmd, msg, level);
-    msgcmdbuf = realloc(msgcmdbuf, needed + 1);
-    if (msgcmdbuf == NULL)
-      err(EXIT_FAILURE, "Memory allocation failed");
-    sprintf(msgcmdbuf, msgcmd, msg, level);
-    if (system(msgcmdbuf) == -1) { /* Ignore command errors... */ }
+  double start;
+
+  template_render(msg, message, sizeof(message), NULL, &battery);
+
+  if (!template_empty(msgcmd)) {
+    template_render(msgcmd, command, sizeof(command), message, &battery);
+    start = metrics_start();
+    if (system(command) == -1) { /* Ignore command errors... */ }
+    metrics_observe(METRIC_COMMAND, start);
   }
 
-  if (notification && msg[0] != '\0') {
+#ifndef NO_NOTIFY
+  if (notification && message[0] != '\0') {
     sprintf(body, "Battery level: %u%%", battery.level);
-    notify_notification_update(notification, msg, body, notification_icon);
+    notify_notification_update(notification, message, body, notification_icon);
     notify_notification_set_urgency(notification, urgency);
+    start = metrics_start();
     notify_notification_show(notification, NULL);
+    metrics_observe(METRIC_NOTIFY, start);
+  }
+#else
+  /* without desktop notifications, stderr ends up in the journal under
+   * systemd, unless the message command already delivers the message */
+  if (journal && message[0] != '\0' && template_empty(msgcmd)) {
+    sprintf(body, "Battery level: %u%%", battery.level);
+    start = metrics_start();
+    fprintf(stderr, "%s%s - %s\n",
+        urgency == NOTIFY_URGENCY_CRITICAL ? JOURNAL_CRITICAL : JOURNAL_NOTICE, message, body);
+    metrics_observe(METRIC_NOTIFY, start);
   }
+#endif
 }
 
 void close_notification()
 {
+#ifndef NO_NOTIFY
   notify_notification_close(notification, NULL);
+#endif
 }
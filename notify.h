@@ -5,13 +5,32 @@
 #ifndef NOTIFY_H
 #define NOTIFY_H
 
+#include "battery.h"
+#include "template.h"
+
+#ifndef NO_NOTIFY
 #include <libnotify/notification.h>
 #include <libnotify/notify.h>
-#include "battery.h"
+#else
+/* same values as libnotify, messages go to the journal instead */
+typedef enum {
+  NOTIFY_URGENCY_LOW,
+  NOTIFY_URGENCY_NORMAL,
+  NOTIFY_URGENCY_CRITICAL
+} NotifyUrgency;
+
+#define NOTIFY_EXPIRES_DEFAULT -1
+#define NOTIFY_EXPIRES_NEVER 0
+#endif
+
+/* syslog priorities prefixed to messages written to the journal */
+#define JOURNAL_CRITICAL "<2>"
+#define JOURNAL_NOTICE "<5>"
 
 void notification_init(char* appname, char *icon, int expires);
-void set_message_command(char *command);
-void notify(char *msg, NotifyUrgency urgency, BatteryState battery);
+void set_message_command(Template *command);
+void notify(Template *msg, NotifyUrgency urgency, BatteryState battery);
 void close_notification();
+void notification_uninit();
 
 #endif
@@ -6,15 +6,49 @@
 #include "options.h"
 #include <err.h>
 #include <errno.h>
-#include <libnotify/notify.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include "danger.h"
+#include "json.h"
 #include "main.h"
+#include "notify.h"
+
+static char* copy(const char *value)
+{
+  char *copy = strdup(value);
+
+  if (copy == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  return copy;
+}
+
+/* options given again replace what an earlier one set */
+static void set_string(char **field, const char *value)
+{
+  free(*field);
+  *field = copy(value);
+}
+
+static void set_template(Template **field, const char *format, bool printf_compat)
+{
+  template_free(*field);
+  *field = template_compile(format, printf_compat);
+}
+
+static void free_strings(char **strings, int count)
+{
+  for (int i = 0; i < count; i++)
+    free(strings[i]);
+  free(strings);
+}
 
 static int split(char *in, char delim, char ***out)
 {
+  char delims[] = { delim, '\0' };
+  char *buffer;
   int count = 1;
 
   if (in[0] == '\0')
@@ -31,17 +65,20 @@ static int split(char *in, char delim, char ***out)
   if (*out == NULL)
     err(EXIT_FAILURE, "Memory allocation failed");
 
-  (*out)[0] = strtok(in, &delim);
+  buffer = copy(in);
+  char *first = strtok(buffer, delims);
+  (*out)[0] = first ? copy(first) : NULL;
   for (int i = 1; i < count; i++) {
-    char *tok = strtok(NULL, &delim);
+    char *tok = strtok(NULL, delims);
     if (tok)
-      (*out)[i] = tok;
+      (*out)[i] = copy(tok);
     else {
       count--;
       i--;
     }
   }
 
+  free(buffer);
   return count;
 }
 
@@ -87,10 +124,16 @@ char* find_config_file()
   return config_file;
 }
 
-char** read_config_file(char *path, int *argc, char *argv0)
+void free_args(int argc, char *argv[])
+{
+  for (int i = 0; i < argc; i++)
+    free(argv[i]);
+  free(argv);
+}
+
+char** read_config_stream(FILE *file, int *argc, char *argv0)
 {
   char **argv;
-  FILE *file;
   size_t numlines_allocated = 128;
   char **ptr;
   char *end;
@@ -98,16 +141,12 @@ char** read_config_file(char *path, int *argc, char *argv0)
   size_t maxbytes = 0;
   size_t buffer_increment = 512 * sizeof(char*);
 
-  file = fopen(path, "r");
-  if (file == NULL) {
-    err(EXIT_FAILURE, "Could not read %s", path);
-  }
-
   argv = malloc(numlines_allocated);
   argv[0] = argv0;
   *argc = 1;
   ptr = argv;
   ptr++;
+  *ptr = NULL;
 
   while((numchars = getline(ptr, &maxbytes, file)) != -1) {
     maxbytes = 0;
@@ -115,35 +154,149 @@ char** read_config_file(char *path, int *argc, char *argv0)
     while(end >= *ptr && ((unsigned char)*end == '\n' || (unsigned char)*end == '\r'))
       end--;
     end[1] = '\0';
-    if (*ptr[0] == '\0' || *ptr[0] == '#')
+    if (*ptr[0] == '\0' || *ptr[0] == '#') {
+      free(*ptr);
+      *ptr = NULL;
       continue;
+    }
 
     ptr++; (*argc)++;
-    if((size_t)*argc > (numlines_allocated/sizeof(char *))) {
+    if((size_t)*argc >= (numlines_allocated/sizeof(char *))) {
       argv = realloc(argv, numlines_allocated + buffer_increment);
       if (argv == NULL)
         err(EXIT_FAILURE, "Memory allocation failed");
       numlines_allocated += buffer_increment;
       ptr = argv + *argc;
     }
+    *ptr = NULL;
   }
 
+  /* the last read allocates a line even at the end of the file */
+  free(*ptr);
   *(ptr) = 0;
-  argv = realloc(argv, sizeof(char*) * *argc+1);
+  argv = realloc(argv, sizeof(char*) * (*argc + 1));
   if (argv == NULL)
     err(EXIT_FAILURE, "Memory allocation failed");
 
-  if (file)
-    fclose(file);
   return argv;
 }
 
+char** read_config_file(char *path, int *argc, char *argv0)
+{
+  char **argv;
+  FILE *file;
+
+  file = fopen(path, "r");
+  if (file == NULL) {
+    err(EXIT_FAILURE, "Could not read %s", path);
+  }
+  argv = read_config_stream(file, argc, argv0);
+  fclose(file);
+  return argv;
+}
+
+void default_options(Config *config)
+{
+  *config = (Config){
+    .daemonize = false,
+    .run_once = false,
+    .battery_required = true,
+    .show_notifications = true,
+    .show_charging_msg = false,
+    .prepare_hibernate = false,
+    .shared_state = false,
+    .serve_clients = false,
+    .serve_dbus = false,
+    .uevents = false,
+    .help = false,
+    .version = false,
+    .battery_names = NULL,
+    .battery_count = 0,
+    .freeze_cgroups = NULL,
+    .freeze_count = 0,
+    .powersave = NULL,
+    .powersave_count = 0,
+    .output_format = JSON_NONE,
+    .metrics_address = copy(""),
+    .metrics_file = copy(""),
+    .root = copy(""),
+    .multiplier = 60,
+    .fixed = false,
+    .warning = LEVEL_WARNING,
+    .critical = LEVEL_CRITICAL,
+    .danger = LEVEL_DANGER,
+    .full = LEVEL_FULL,
+    .warning_minutes = 0,
+    .critical_minutes = 0,
+    .danger_minutes = 0,
+    .warningmsg = template_compile("Battery is low", false),
+    .criticalmsg = template_compile("Battery is critically low", false),
+    .fullmsg = template_compile("Battery is full", false),
+    .chargingmsg = template_compile("Battery is charging", false),
+    .dischargingmsg = template_compile("Battery is discharging", false),
+    .dangercmd = copy(""),
+    .dangersteps = NULL,
+    .dangerstep_count = 0,
+    .bank_spread = 0,
+    .groups = NULL,
+    .group_count = 0,
+    .rules = NULL,
+    .rule_count = 0,
+    .msgcmd = NULL,
+    .appname = copy(PROGNAME),
+    .icon = NULL,
+    .notification_expires = NOTIFY_EXPIRES_NEVER
+  };
+}
+
+static const char *optstring = ":hvbosqiew:c:d:f:pHW:C:D:A:F:P:U:M:Nn:m:a:I:Z:S:R:LBx:k:j:r:g:O:u";
+
+bool query_requested(int argc, char *argv[])
+{
+  bool query = false;
+  signed int c;
+
+  optind = 0;
+  while ((c = getopt(argc, argv, optstring)) != -1)
+    query |= c == 'q';
+  return query;
+}
+
+/* a level in percent, or in minutes of predicted runtime with an m suffix;
+ * only the one given is set, false if arg is neither */
+bool read_level(char *arg, int *level, int *minutes)
+{
+  char *end;
+  long value;
+
+  errno = 0;
+  value = strtol(arg, &end, 10);
+  if (end == arg || (*end != '\0' && strcmp(end, "m") != 0) || errno || value < 0 || value > INT_MAX)
+    return false;
+  if (*end == 'm')
+    *minutes = value;
+  else
+    *level = value;
+  return true;
+}
+
+static void parse_level(char option, char *arg, int *level, int *minutes)
+{
+  if (!read_level(arg, level, minutes))
+    errx(EXIT_FAILURE, "Option -%c must be a percentage or minutes followed by m.", option);
+}
+
+/* arguments are copied and never changed in place, the command line is
+ * parsed again on reload and the arguments may be freed once parsed */
 void parse_args(int argc, char *argv[], Config *config)
 {
   signed int c;
-  optind = 1;
+  char *arg;
+
+  /* 0 resets getopt fully, it must not look back into freed arguments */
+  optind = 0;
 
-  while ((c = getopt(argc, argv, ":hvboiew:c:d:f:pW:C:D:F:P:U:M:Nn:m:a:I:")) != -1) {
+  while ((c = getopt(argc, argv, optstring)) != -1) {
     switch (c) {
       case 'h':
         config->help = true;
@@ -157,17 +310,23 @@ void parse_args(int argc, char *argv[], Config *config)
       case 'o':
         config->run_once = true;
         break;
+      case 's':
+        config->shared_state = true;
+        break;
+      case 'q':
+        config->run_once = true;
+        break;
       case 'i':
         config->battery_required = false;
         break;
       case 'w':
-        config->warning = strtoul(optarg, NULL, 10);
+        parse_level('w', optarg, &config->warning, &config->warning_minutes);
         break;
       case 'c':
-        config->critical = strtoul(optarg, NULL, 10);
+        parse_level('c', optarg, &config->critical, &config->critical_minutes);
         break;
       case 'd':
-        config->danger = strtoul(optarg, NULL, 10);
+        parse_level('d', optarg, &config->danger, &config->danger_minutes);
         break;
       case 'f':
         config->full = strtoul(optarg, NULL, 10);
@@ -177,33 +336,89 @@ void parse_args(int argc, char *argv[], Config *config)
         config->show_charging_msg = 1;
         config->fixed = true;
         break;
+      case 'H':
+        config->prepare_hibernate = true;
+        break;
       case 'W':
-        config->warningmsg = optarg;
+        set_template(&config->warningmsg, optarg, false);
         break;
       case 'C':
-        config->criticalmsg = optarg;
+        set_template(&config->criticalmsg, optarg, false);
         break;
       case 'D':
-        config->dangercmd = optarg;
+        set_string(&config->dangercmd, optarg);
+        break;
+      case 'A':
+        arg = copy(optarg);
+        config->dangerstep_count = parse_danger_steps(arg, &config->dangersteps);
+        free(arg);
         break;
       case 'F':
-        config->fullmsg = optarg;
+        set_template(&config->fullmsg, optarg, false);
         break;
       case 'P':
-        config->chargingmsg = optarg;
+        set_template(&config->chargingmsg, optarg, false);
         break;
       case 'U':
-        config->dischargingmsg = optarg;
+        set_template(&config->dischargingmsg, optarg, false);
         break;
       case 'M':
-        config->msgcmd = optarg;
+        set_template(&config->msgcmd, optarg, true);
         break;
       case 'N':
         config->show_notifications = false;
         break;
       case 'n':
+        free_strings(config->battery_names, config->battery_count);
+        config->battery_names = NULL;
         config->battery_count = split(optarg, ',', &config->battery_names);
         break;
+      case 'Z':
+        free_strings(config->freeze_cgroups, config->freeze_count);
+        config->freeze_cgroups = NULL;
+        config->freeze_count = split(optarg, ',', &config->freeze_cgroups);
+        break;
+      case 'S':
+        arg = copy(optarg);
+        config->powersave_count = parse_powersave(arg, &config->powersave, config->powersave_count);
+        free(arg);
+        break;
+      case 'O':
+        config->bank_spread = strtoul(optarg, NULL, 10);
+        break;
+      case 'u':
+        config->uevents = true;
+        break;
+      case 'g':
+        arg = copy(optarg);
+        config->group_count = parse_group(arg, &config->groups, config->group_count);
+        free(arg);
+        break;
+      case 'r':
+        arg = copy(optarg);
+        config->rule_count = parse_rule(arg, &config->rules, config->rule_count);
+        free(arg);
+        break;
+      case 'R':
+        set_string(&config->root, optarg);
+        break;
+      case 'L':
+        config->serve_clients = true;
+        break;
+      case 'B':
+        config->serve_dbus = true;
+        break;
+      case 'j':
+        config->output_format = json_format(optarg);
+        if (config->output_format < 0)
+          errx(EXIT_FAILURE, "Unknown output format `%s'.", optarg);
+        break;
+      case 'x':
+        set_string(&config->metrics_address, optarg);
+        break;
+      case 'k':
+        set_string(&config->metrics_file, optarg);
+        break;
       case 'm':
         if (optarg[0] == '+') {
           config->fixed = true;
@@ -213,10 +428,10 @@ void parse_args(int argc, char *argv[], Config *config)
         }
         break;
       case 'a':
-        config->appname = optarg;
+        set_string(&config->appname, optarg);
         break;
       case 'I':
-        config->icon = optarg;
+        set_string(&config->icon, optarg);
         break;
       case 'e':
         config->notification_expires = NOTIFY_EXPIRES_DEFAULT;
@@ -229,10 +444,36 @@ void parse_args(int argc, char *argv[], Config *config)
   }
 }
 
+/* everything a config points to is its own, parsed options are copied */
+void free_options(Config *config)
+{
+  free_strings(config->battery_names, config->battery_count);
+  free_strings(config->freeze_cgroups, config->freeze_count);
+  powersave_free(config->powersave, config->powersave_count);
+  free(config->metrics_address);
+  free(config->metrics_file);
+  free(config->root);
+  template_free(config->warningmsg);
+  template_free(config->criticalmsg);
+  template_free(config->fullmsg);
+  template_free(config->chargingmsg);
+  template_free(config->dischargingmsg);
+  free(config->dangercmd);
+  free(config->dangersteps);
+  groups_free(config->groups, config->group_count);
+  rules_free(config->rules, config->rule_count);
+  template_free(config->msgcmd);
+  free(config->appname);
+  free(config->icon);
+}
+
 void validate_options(Config *config)
 {
   int lowlvl = config->danger;
   char *rangemsg = "Option -%c must be between 0 and %i.";
+  char *minutesmsg = "Option -%c minutes must be between 0 and %i.";
+  char *end;
+  long port;
 
   /* Sanity check numberic values */
   if (config->warning > 100 || config->warning < 0) errx(EXIT_FAILURE, rangemsg, 'w', 100);
@@ -240,12 +481,38 @@ void validate_options(Config *config)
   if (config->danger > 100 || config->danger < 0) errx(EXIT_FAILURE, rangemsg, 'd', 100);
   if (config->full > 100 || config->full < 0) errx(EXIT_FAILURE, rangemsg, 'f', 100);
   if (config->multiplier < 0 || config->multiplier > 3600) errx(EXIT_FAILURE, rangemsg, 'm', 3600);
+  if (config->bank_spread > 100 || config->bank_spread < 0) errx(EXIT_FAILURE, rangemsg, 'O', 100);
+  if (config->warning_minutes > 1440 || config->warning_minutes < 0) errx(EXIT_FAILURE, minutesmsg, 'w', 1440);
+  if (config->critical_minutes > 1440 || config->critical_minutes < 0) errx(EXIT_FAILURE, minutesmsg, 'c', 1440);
+  if (config->danger_minutes > 1440 || config->danger_minutes < 0) errx(EXIT_FAILURE, minutesmsg, 'd', 1440);
 
   /* Enssure levels are correctly ordered */
   if (config->warning && config->warning <= config->critical)
     errx(EXIT_FAILURE, "Warning level must be greater than critical.");
   if (config->critical && config->critical <= config->danger)
     errx(EXIT_FAILURE, "Critical level must be greater than danger.");
+  if (config->warning_minutes && config->warning_minutes <= config->critical_minutes)
+    errx(EXIT_FAILURE, "Warning time must be greater than critical.");
+  if (config->critical_minutes && config->critical_minutes <= config->danger_minutes)
+    errx(EXIT_FAILURE, "Critical time must be greater than danger.");
+
+  /* A command step needs a command to run */
+  for (int i = 0; i < config->dangerstep_count; i++)
+    if (config->dangersteps[i].action == DANGER_COMMAND && config->dangercmd[0] == '\0')
+      errx(EXIT_FAILURE, "Danger action `command' requires option -D.");
+
+  /* a path means a Unix socket, anything else must be a port */
+  if (config->metrics_address[0] != '\0' && config->metrics_address[0] != '/') {
+    errno = 0;
+    port = strtol(config->metrics_address, &end, 10);
+    if (end == config->metrics_address || *end != '\0' || errno || port < 1 || port > 65535)
+      errx(EXIT_FAILURE, "Option -x must be a socket path or a port between 1 and 65535.");
+  }
+
+#ifdef NO_DBUS
+  if (config->serve_dbus)
+    errx(EXIT_FAILURE, "Option -B is not available, built without D-Bus support.");
+#endif
 
   /* Find highest warning level */
   if (config->warning || config->critical)
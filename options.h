@@ -7,6 +7,12 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include "danger.h"
+#include "group.h"
+#include "powersave.h"
+#include "rules.h"
+#include "template.h"
 
 typedef struct Config {
   /* program operation options */
@@ -15,6 +21,11 @@ typedef struct Config {
   bool battery_required;
   bool show_notifications;
   bool show_charging_msg;
+  bool prepare_hibernate;
+  bool shared_state;
+  bool serve_clients;
+  bool serve_dbus;
+  bool uevents;
   bool help;
   bool version;
 
@@ -22,6 +33,24 @@ typedef struct Config {
   char **battery_names;
   int battery_count;
 
+  /* cgroups frozen at critical level */
+  char **freeze_cgroups;
+  int freeze_count;
+
+  /* power saving settings applied at battery states */
+  PowerSave *powersave;
+  int powersave_count;
+
+  /* stream state changes to stdout in this format */
+  int output_format;
+
+  /* metrics HTTP endpoint and node_exporter textfile */
+  char *metrics_address;
+  char *metrics_file;
+
+  /* prefix for system paths */
+  char *root;
+
   /* check frequency multiplier (seconds) */
   int multiplier;
   bool fixed;
@@ -32,18 +61,38 @@ typedef struct Config {
   int danger;
   int full;
 
+  /* warning levels in minutes of predicted runtime, 0 if unused */
+  int warning_minutes;
+  int critical_minutes;
+  int danger_minutes;
+
   /* messages for battery levels */
-  char *warningmsg;
-  char *criticalmsg;
-  char *fullmsg;
-  char *chargingmsg;
-  char *dischargingmsg;
+  Template *warningmsg;
+  Template *criticalmsg;
+  Template *fullmsg;
+  Template *chargingmsg;
+  Template *dischargingmsg;
 
   /* run this system command if battery reaches danger level */
   char *dangercmd;
 
+  /* escalating logind actions if battery reaches danger level */
+  DangerStep *dangersteps;
+  int dangerstep_count;
+
+  /* percentage points from the bank level that make a battery an outlier */
+  int bank_spread;
+
+  /* batteries with their own levels and messages */
+  Group *groups;
+  int group_count;
+
+  /* actions taken when the level or time left crosses a threshold */
+  Rule *rules;
+  int rule_count;
+
   /* run this system command to display a message */
-  char *msgcmd;
+  Template *msgcmd;
 
   /* app name for notification */
   char *appname;
@@ -55,9 +104,15 @@ typedef struct Config {
   int notification_expires;
 } Config;
 
+void default_options(Config *config);
 char* find_config_file();
+char** read_config_stream(FILE *file, int *argc, char *argv0);
 char** read_config_file(char *path, int *argc, char *argv0);
+void free_args(int argc, char *argv[]);
+bool read_level(char *arg, int *level, int *minutes);
+bool query_requested(int argc, char *argv[]);
 void parse_args(int argc, char *argv[], Config *config);
 void validate_options(Config *config);
+void free_options(Config *config);
 
 #endif
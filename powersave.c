@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "battery.h"
+#include "powersave.h"
+
+#define VALUE_LENGTH 64
+
+/* original value of a file we changed */
+typedef struct Saved {
+  char *path;
+  char value[VALUE_LENGTH];
+} Saved;
+
+static char *sys_root = "";
+static PowerSave *powersave = NULL;
+static bool *applied = NULL;
+static int powersave_count = 0;
+
+static Saved *saved = NULL;
+static int saved_count = 0;
+
+static char* root_path(char *path)
+{
+  static char buf[4096];
+
+  snprintf(buf, sizeof(buf), "%s%s", sys_root, path);
+  return buf;
+}
+
+static bool read_value(char *path, char *value)
+{
+  FILE *file;
+  bool ok;
+
+  file = fopen(path, "r");
+  if (file == NULL)
+    return false;
+  ok = fgets(value, VALUE_LENGTH, file) != NULL;
+  fclose(file);
+  if (ok)
+    value[strcspn(value, "\n")] = '\0';
+  return ok;
+}
+
+static bool write_value(char *path, char *value)
+{
+  FILE *file;
+  bool ok;
+
+  file = fopen(path, "w");
+  if (file == NULL) {
+    warn("Could not open %s", path);
+    return false;
+  }
+  ok = fputs(value, file) >= 0;
+  ok &= fclose(file) == 0;
+  if (!ok)
+    warn("Could not write %s", path);
+  return ok;
+}
+
+/* change a file, remembering its value from before our first change */
+static void change_value(char *path, char *value)
+{
+  int i;
+
+  for (i = 0; i < saved_count; i++)
+    if (strcmp(saved[i].path, path) == 0)
+      break;
+
+  if (i == saved_count) {
+    saved = realloc(saved, sizeof(Saved) * (saved_count + 1));
+    if (saved == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    if (!read_value(path, saved[i].value))
+      return;
+    saved[i].path = strdup(path);
+    if (saved[i].path == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    saved_count++;
+  }
+
+  write_value(path, value);
+}
+
+static void change_matching(char *pattern, char *value)
+{
+  glob_t matches;
+
+  if (glob(root_path(pattern), 0, NULL, &matches) == 0)
+    for (size_t i = 0; i < matches.gl_pathc; i++)
+      change_value(matches.gl_pathv[i], value);
+  globfree(&matches);
+}
+
+static void cap_backlight(int percent)
+{
+  glob_t matches;
+  char path[4096];
+  char value[VALUE_LENGTH];
+  long max;
+  long cap;
+
+  if (glob(root_path(BACKLIGHT_SUBSYSTEM "/*/max_brightness"), 0, NULL, &matches) == 0) {
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+      if (!read_value(matches.gl_pathv[i], value))
+        continue;
+      max = strtol(value, NULL, 10);
+      cap = max * percent / 100;
+      /* brightness 0 turns some panels off altogether */
+      if (cap < 1)
+        cap = 1;
+
+      snprintf(path, sizeof(path), "%s", matches.gl_pathv[i]);
+      strcpy(strrchr(path, '/'), "/brightness");
+      if (!read_value(path, value) || strtol(value, NULL, 10) <= cap)
+        continue;
+      snprintf(value, sizeof(value), "%ld", cap);
+      change_value(path, value);
+    }
+  }
+  globfree(&matches);
+}
+
+static void disable_turbo()
+{
+  char value[VALUE_LENGTH];
+
+  /* intel_pstate has its own switch, other drivers use the generic boost */
+  if (read_value(root_path(NO_TURBO_PATH), value))
+    change_value(root_path(NO_TURBO_PATH), "1");
+  else if (read_value(root_path(BOOST_PATH), value))
+    change_value(root_path(BOOST_PATH), "0");
+}
+
+static char* copy(char *value)
+{
+  char *copy;
+
+  if (value == NULL)
+    return NULL;
+  if ((copy = strdup(value)) == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  return copy;
+}
+
+int parse_powersave(char *spec, PowerSave **sets, int count)
+{
+  char *value;
+  char *const keys[] = { "level", "profile", "epp", "backlight", "noturbo", NULL };
+  char *levels[] = { "ac", "discharging", "warning", "critical", "danger" };
+  PowerSave *set;
+
+  *sets = realloc(*sets, sizeof(PowerSave) * (count + 1));
+  if (*sets == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  set = &(*sets)[count];
+  *set = (PowerSave){ .state = STATE_CRITICAL, .backlight = 0 };
+
+  while (*spec != '\0') {
+    switch (getsubopt(&spec, keys, &value)) {
+      case 0:
+        set->state = STATE_AC;
+        for (int i = STATE_DISCHARGING; value && i <= STATE_DANGER; i++)
+          if (strcmp(value, levels[i]) == 0)
+            set->state = i;
+        if (set->state == STATE_AC)
+          errx(EXIT_FAILURE, "Unknown power saving level `%s'.", value ? value : "");
+        break;
+      case 1:
+        free(set->profile);
+        set->profile = copy(value);
+        break;
+      case 2:
+        free(set->epp);
+        set->epp = copy(value);
+        break;
+      case 3:
+        set->backlight = value ? strtoul(value, NULL, 10) : 0;
+        if (set->backlight < 1 || set->backlight > 100)
+          errx(EXIT_FAILURE, "Backlight cap must be between 1 and 100.");
+        break;
+      case 4:
+        set->noturbo = true;
+        break;
+      default:
+        errx(EXIT_FAILURE, "Unknown power saving option `%s'.", value);
+    }
+  }
+
+  return count + 1;
+}
+
+void powersave_free(PowerSave *sets, int count)
+{
+  for (int i = 0; i < count; i++) {
+    free(sets[i].profile);
+    free(sets[i].epp);
+  }
+  free(sets);
+}
+
+void powersave_init(char *root, PowerSave *sets, int count)
+{
+  sys_root = root;
+  powersave = sets;
+  powersave_count = count;
+  free(applied);
+  applied = calloc(count, sizeof(bool));
+  if (count > 0 && applied == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+}
+
+void powersave_apply(char state)
+{
+  for (int i = 0; i < powersave_count; i++) {
+    if (applied[i] || state < powersave[i].state)
+      continue;
+    applied[i] = true;
+
+    if (powersave[i].profile)
+      change_value(root_path(PLATFORM_PROFILE_PATH), powersave[i].profile);
+    if (powersave[i].epp)
+      change_matching(EPP_PATHS, powersave[i].epp);
+    if (powersave[i].backlight)
+      cap_backlight(powersave[i].backlight);
+    if (powersave[i].noturbo)
+      disable_turbo();
+  }
+}
+
+void powersave_restore()
+{
+  for (int i = 0; i < powersave_count; i++)
+    applied[i] = false;
+
+  /* reverse order, in case one setting constrains another */
+  while (saved_count > 0) {
+    saved_count--;
+    write_value(saved[saved_count].path, saved[saved_count].value);
+    free(saved[saved_count].path);
+  }
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef POWERSAVE_H
+#define POWERSAVE_H
+
+#include <stdbool.h>
+
+/* system paths */
+#define PLATFORM_PROFILE_PATH "/sys/firmware/acpi/platform_profile"
+#define EPP_PATHS "/sys/devices/system/cpu/cpufreq/policy*/energy_performance_preference"
+#define BACKLIGHT_SUBSYSTEM "/sys/class/backlight"
+#define NO_TURBO_PATH "/sys/devices/system/cpu/intel_pstate/no_turbo"
+#define BOOST_PATH "/sys/devices/system/cpu/cpufreq/boost"
+
+/* power saving settings applied once the battery reaches a state */
+typedef struct PowerSave {
+  char state;
+  char *profile;
+  char *epp;
+  int backlight;
+  bool noturbo;
+} PowerSave;
+
+int parse_powersave(char *spec, PowerSave **sets, int count);
+void powersave_init(char *root, PowerSave *sets, int count);
+void powersave_free(PowerSave *sets, int count);
+void powersave_apply(char state);
+void powersave_restore();
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "prepare.h"
+
+/* work is queued for one detached worker, which runs until none is left
+ * and signals idle when it stops */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle;
+static bool worker_running = false;
+static bool writeback_queued = false;
+static bool hibernate_queued = false;
+
+/* the vm paths under the sysfs root, a user service can't write them */
+static char drop_caches_path[4096] = DROP_CACHES_PATH;
+static char compact_memory_path[4096] = COMPACT_MEMORY_PATH;
+static bool denied = false;
+
+static double clock_ms()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool write_value(char *path, char *value)
+{
+  int fd;
+  bool ok;
+
+  fd = open(path, O_WRONLY);
+  if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+    if (!denied)
+      warnx("Dropping caches and compacting memory need root, skipping them");
+    denied = true;
+    return false;
+  } else if (fd < 0) {
+    warn("Could not open %s", path);
+    return false;
+  }
+  ok = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+  if (!ok)
+    warn("Could not write %s", path);
+  close(fd);
+  return ok;
+}
+
+/* flush dirty data of every block device backed filesystem */
+static void writeback()
+{
+  FILE *mounts;
+  struct mntent *mnt;
+  int fd;
+  int count = 0;
+  double start = clock_ms();
+
+  mounts = setmntent(MOUNTS_PATH, "r");
+  if (mounts == NULL) {
+    warn("Could not read %s", MOUNTS_PATH);
+    return;
+  }
+  while ((mnt = getmntent(mounts)) != NULL) {
+    if (strncmp(mnt->mnt_fsname, "/dev/", 5) != 0)
+      continue;
+    fd = open(mnt->mnt_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+      continue;
+    if (syncfs(fd) == 0)
+      count++;
+    close(fd);
+  }
+  endmntent(mounts);
+
+  printf("Wrote back %d filesystems in %.0f ms\n", count, clock_ms() - start);
+  fflush(stdout);
+}
+
+/* shrink the image a hibernate has to write, each step is tried on its own */
+static void hibernate()
+{
+  double start = clock_ms();
+
+  /* only clean page cache is dropped, dirty pages are left to writeback */
+  if (write_value(drop_caches_path, "1"))
+    printf("Dropped caches in %.0f ms\n", clock_ms() - start);
+  start = clock_ms();
+  if (write_value(compact_memory_path, "1"))
+    printf("Compacted memory in %.0f ms\n", clock_ms() - start);
+  fflush(stdout);
+}
+
+static void* worker(void *arg)
+{
+  bool do_writeback;
+  bool do_hibernate;
+
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    do_writeback = writeback_queued;
+    do_hibernate = hibernate_queued;
+    writeback_queued = hibernate_queued = false;
+    if (!do_writeback && !do_hibernate) {
+      worker_running = false;
+      pthread_cond_broadcast(&idle);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!do_writeback && !do_hibernate)
+      return NULL;
+    if (do_writeback)
+      writeback();
+    if (do_hibernate)
+      hibernate();
+  }
+}
+
+/* work queued while the worker runs is picked up by it when done */
+static void queue(bool *queued)
+{
+  pthread_t thread;
+
+  pthread_mutex_lock(&lock);
+  *queued = true;
+  if (!worker_running) {
+    worker_running = pthread_create(&thread, NULL, worker, NULL) == 0;
+    if (worker_running)
+      pthread_detach(thread);
+    else
+      warnx("Could not start preparing for hibernation");
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void prepare_init(char *root)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&idle, &attr);
+  pthread_condattr_destroy(&attr);
+
+  snprintf(drop_caches_path, sizeof(drop_caches_path), "%s" DROP_CACHES_PATH, root);
+  snprintf(compact_memory_path, sizeof(compact_memory_path), "%s" COMPACT_MEMORY_PATH, root);
+}
+
+/* wait for queued work to finish, false if it is still running at the timeout */
+bool prepare_wait(int seconds)
+{
+  struct timespec until;
+  int status = 0;
+  bool done;
+
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  until.tv_sec += seconds;
+
+  pthread_mutex_lock(&lock);
+  while (worker_running && status == 0)
+    status = pthread_cond_timedwait(&idle, &lock, &until);
+  done = !worker_running;
+  pthread_mutex_unlock(&lock);
+
+  if (!done) {
+    printf("Preparing for hibernation still running after %d s, continuing\n", seconds);
+    fflush(stdout);
+  }
+  return done;
+}
+
+void prepare_writeback()
+{
+  queue(&writeback_queued);
+}
+
+void prepare_hibernate()
+{
+  queue(&hibernate_queued);
+}
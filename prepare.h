@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef PREPARE_H
+#define PREPARE_H
+
+#include <stdbool.h>
+
+/* system paths */
+#define MOUNTS_PATH "/proc/self/mounts"
+#define DROP_CACHES_PATH "/proc/sys/vm/drop_caches"
+#define COMPACT_MEMORY_PATH "/proc/sys/vm/compact_memory"
+
+/* seconds the danger level waits for the preparation before its first step */
+#define PREPARE_TIMEOUT 10
+
+void prepare_init(char *root);
+bool prepare_wait(int seconds);
+void prepare_writeback();
+void prepare_hibernate();
+
+#endif
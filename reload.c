@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bank.h"
+#include "event.h"
+#include "freeze.h"
+#include "group.h"
+#include "metrics.h"
+#include "notify.h"
+#include "options.h"
+#include "powersave.h"
+#include "reload.h"
+#include "rules.h"
+#include "server.h"
+#include "shm.h"
+
+/* the command line, kept unparsed because parsing modifies arguments */
+static int saved_argc = 0;
+static char **saved_argv = NULL;
+
+/* the watched configuration file */
+static char *watched_path = NULL;
+static char *watched_name = NULL;
+static int watch_fd = -1;
+static int watch_wd = -1;
+
+static char** copy_args(int argc, char *argv[])
+{
+  char **copy = malloc(sizeof(char *) * (argc + 1));
+
+  if (copy == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  for (int i = 0; i < argc; i++) {
+    copy[i] = strdup(argv[i]);
+    if (copy[i] == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+  }
+  copy[argc] = NULL;
+  return copy;
+}
+
+/* a change in the watched directory, only the config file itself matters */
+static void watch_event(int fd, short revents, void *data)
+{
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *event;
+  bool changed = false;
+  ssize_t length;
+
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+    for (char *p = buffer; p < buffer + length; p += sizeof(*event) + event->len) {
+      event = (struct inotify_event *)p;
+      changed |= event->len > 0 && strcmp(event->name, watched_name) == 0;
+    }
+  }
+
+  /* reloads go through SIGHUP, so both triggers are handled the same way;
+   * a burst of writes leaves a single pending signal */
+  if (changed)
+    kill(getpid(), SIGHUP);
+}
+
+/* editors usually replace the file, so the directory is watched instead */
+static void watch_config(char *path)
+{
+  char *dir;
+
+  if (path == NULL || (watched_path && strcmp(path, watched_path) == 0))
+    return;
+
+  if (watch_fd < 0) {
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0) {
+      warn("Could not watch %s", path);
+      return;
+    }
+    event_add(watch_fd, POLLIN, watch_event, NULL);
+  }
+  if (watch_wd >= 0)
+    inotify_rm_watch(watch_fd, watch_wd);
+
+  free(watched_path);
+  free(watched_name);
+  watched_path = strdup(path);
+  watched_name = strdup(path);
+  dir = strdup(path);
+  if (watched_path == NULL || watched_name == NULL || dir == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  strcpy(watched_name, basename(watched_name));
+
+  watch_wd = inotify_add_watch(watch_fd, dirname(dir),
+      IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if (watch_wd < 0)
+    warn("Could not watch %s", path);
+  free(dir);
+}
+
+/* the configuration file as read for one reload, the check and the reload
+ * itself parse these same bytes, so an edit in between can't slip past */
+typedef struct Snapshot {
+  char *path;
+  char *data;
+  size_t length;
+} Snapshot;
+
+static bool snapshot_config(Snapshot *snapshot)
+{
+  char buffer[4096];
+  FILE *file;
+  FILE *copy;
+  size_t length;
+  bool ok;
+
+  *snapshot = (Snapshot){ .path = find_config_file(), .data = NULL, .length = 0 };
+  if (snapshot->path == NULL)
+    return true;
+
+  file = fopen(snapshot->path, "r");
+  if (file == NULL) {
+    warn("Could not read %s", snapshot->path);
+    return false;
+  }
+  copy = open_memstream(&snapshot->data, &snapshot->length);
+  if (copy == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    fwrite(buffer, 1, length, copy);
+  ok = !ferror(file);
+  if (!ok)
+    warn("Could not read %s", snapshot->path);
+  fclose(file);
+  fclose(copy);
+  return ok;
+}
+
+static void free_snapshot(Snapshot *snapshot)
+{
+  free(snapshot->path);
+  free(snapshot->data);
+}
+
+/* parse the snapshot and command line into a fresh config */
+static void load(Config *config, Snapshot *snapshot)
+{
+  FILE *file;
+  char **conf_argv;
+  char **args;
+  int conf_argc;
+
+  default_options(config);
+  if (snapshot->length > 0) {
+    file = fmemopen(snapshot->data, snapshot->length, "r");
+    if (file == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    conf_argv = read_config_stream(file, &conf_argc, NULL);
+    fclose(file);
+    parse_args(conf_argc, conf_argv, config);
+    free_args(conf_argc, conf_argv);
+  }
+  args = copy_args(saved_argc, saved_argv);
+  parse_args(saved_argc, args, config);
+  free_args(saved_argc, args);
+}
+
+/* options exit on the first error, so the snapshot is parsed and validated
+ * in a child first and the running configuration is kept if it fails;
+ * groups are resolved there too, against the batteries being monitored.
+ * The child leaves the inotify watch alone, its descriptor is shared */
+static bool check(Config *current, Snapshot *snapshot)
+{
+  Config config;
+  pid_t pid;
+  int status;
+
+  fflush(NULL);
+  switch (pid = fork()) {
+  case -1:
+    warn("Could not check configuration");
+    return false;
+  case 0:
+    load(&config, snapshot);
+    validate_options(&config);
+    if (!groups_init(config.groups, config.group_count, current->battery_names, current->battery_count))
+      _exit(EXIT_FAILURE);
+    _exit(EXIT_SUCCESS);
+  }
+
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool same_string(char *a, char *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+  return strcmp(a, b) == 0;
+}
+
+static bool same_strings(char **a, int a_count, char **b, int b_count)
+{
+  if (a_count != b_count)
+    return false;
+  for (int i = 0; i < a_count; i++)
+    if (!same_string(a[i], b[i]))
+      return false;
+  return true;
+}
+
+static bool same_powersave(PowerSave *a, int a_count, PowerSave *b, int b_count)
+{
+  if (a_count != b_count)
+    return false;
+  for (int i = 0; i < a_count; i++)
+    if (a[i].state != b[i].state || !same_string(a[i].profile, b[i].profile)
+        || !same_string(a[i].epp, b[i].epp) || a[i].backlight != b[i].backlight
+        || a[i].noturbo != b[i].noturbo)
+      return false;
+  return true;
+}
+
+static bool same_groups(Group *a, int a_count, Group *b, int b_count)
+{
+  if (a_count != b_count)
+    return false;
+  for (int i = 0; i < a_count; i++)
+    if (!same_string(a[i].spec, b[i].spec))
+      return false;
+  return true;
+}
+
+static bool same_rules(Rule *a, int a_count, Rule *b, int b_count)
+{
+  if (a_count != b_count)
+    return false;
+  for (int i = 0; i < a_count; i++)
+    if (a[i].condition != b[i].condition || a[i].threshold != b[i].threshold
+        || a[i].action != b[i].action || !same_string(a[i].argument, b[i].argument))
+      return false;
+  return true;
+}
+
+/* hands a setting over from the running config, which gets the one just
+ * parsed in return and is freed with it */
+#define TAKE(config, current, field) swap(&(config)->field, &(current)->field, sizeof((config)->field))
+
+static void swap(void *a, void *b, size_t size)
+{
+  char tmp[sizeof(void *)];
+
+  memcpy(tmp, a, size);
+  memcpy(a, b, size);
+  memcpy(b, tmp, size);
+}
+
+/* settings bound to the running process are kept until a restart */
+static void keep(Config *config, Config *current)
+{
+  if ((config->battery_count > 0 && !same_strings(config->battery_names, config->battery_count,
+          current->battery_names, current->battery_count))
+      || config->battery_required != current->battery_required)
+    warnx("Battery selection changes need a restart");
+  if (!same_string(config->root, current->root))
+    warnx("Option -R changes need a restart");
+  if (config->output_format != current->output_format)
+    warnx("Option -j changes need a restart");
+  if (config->serve_dbus != current->serve_dbus)
+    warnx("Option -B changes need a restart");
+  if (config->uevents != current->uevents)
+    warnx("Option -u changes need a restart");
+
+  config->daemonize = current->daemonize;
+  config->run_once = current->run_once;
+  config->battery_required = current->battery_required;
+  TAKE(config, current, battery_names);
+  TAKE(config, current, battery_count);
+  TAKE(config, current, root);
+  config->output_format = current->output_format;
+  config->serve_dbus = current->serve_dbus;
+  config->uevents = current->uevents;
+}
+
+void reload_init(int argc, char *argv[], char *config_file)
+{
+  saved_argc = argc;
+  saved_argv = copy_args(argc, argv);
+  watch_config(config_file);
+}
+
+bool reload_config(Config *current)
+{
+  Config config;
+  Snapshot snapshot;
+
+  if (!snapshot_config(&snapshot) || !check(current, &snapshot)) {
+    warnx("Configuration not reloaded, keeping the running one");
+    free_snapshot(&snapshot);
+    return false;
+  }
+  load(&config, &snapshot);
+  watch_config(snapshot.path);
+  free_snapshot(&snapshot);
+  keep(&config, current);
+
+  /* only what changed is set up again, modules keep pointing into what
+   * did not, so that is taken over from the previous configuration before
+   * freeing it; a module that fails to start again stays off */
+  if (config.show_notifications != current->show_notifications
+      || !same_string(config.appname, current->appname)
+      || !same_string(config.icon, current->icon)
+      || config.notification_expires != current->notification_expires) {
+    notification_uninit();
+    if (config.show_notifications)
+      notification_init(config.appname, config.icon, config.notification_expires);
+  } else {
+    TAKE(&config, current, appname);
+    TAKE(&config, current, icon);
+  }
+  set_message_command(config.msgcmd);
+
+  if (config.shared_state != current->shared_state) {
+    if (!config.shared_state)
+      shm_uninit();
+    else if (!shm_init())
+      config.shared_state = false;
+  }
+  if (config.serve_clients != current->serve_clients) {
+    if (!config.serve_clients)
+      server_uninit();
+    else if (!server_init())
+      config.serve_clients = false;
+  }
+  if (!same_string(config.metrics_address, current->metrics_address)
+      || !same_string(config.metrics_file, current->metrics_file)) {
+    metrics_uninit();
+    metrics_init(config.metrics_address, config.metrics_file);
+  } else {
+    TAKE(&config, current, metrics_address);
+    TAKE(&config, current, metrics_file);
+  }
+
+  if (!same_strings(config.freeze_cgroups, config.freeze_count,
+        current->freeze_cgroups, current->freeze_count)) {
+    thaw_cgroups(NULL);
+    freeze_init(config.root, config.freeze_cgroups, config.freeze_count);
+  } else {
+    TAKE(&config, current, freeze_cgroups);
+    TAKE(&config, current, freeze_count);
+  }
+  if (!same_powersave(config.powersave, config.powersave_count,
+        current->powersave, current->powersave_count)) {
+    powersave_restore();
+    powersave_init(config.root, config.powersave, config.powersave_count);
+  } else {
+    TAKE(&config, current, powersave);
+    TAKE(&config, current, powersave_count);
+  }
+  if (config.bank_spread != current->bank_spread)
+    bank_init(config.bank_spread, config.battery_count);
+  if (same_groups(config.groups, config.group_count, current->groups, current->group_count)
+      || !groups_init(config.groups, config.group_count, config.battery_names, config.battery_count)) {
+    TAKE(&config, current, groups);
+    TAKE(&config, current, group_count);
+  }
+  /* recompiled rules keep the state of unchanged ones, new or changed
+   * rules that hold fire on the next check */
+  if (!same_rules(config.rules, config.rule_count, current->rules, current->rule_count)) {
+    rules_init(config.rules, config.rule_count);
+  } else {
+    TAKE(&config, current, rules);
+    TAKE(&config, current, rule_count);
+  }
+
+  free_options(current);
+  *current = config;
+  printf("Configuration reloaded\n");
+  fflush(stdout);
+  return true;
+}
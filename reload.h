@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <stdbool.h>
+#include "options.h"
+
+void reload_init(int argc, char *argv[], char *config_file);
+bool reload_config(Config *current);
+
+#endif
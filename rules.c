@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "alert.h"
+#include "battery.h"
+#include "estimate.h"
+#include "logind.h"
+#include "metrics.h"
+#include "notify.h"
+#include "rules.h"
+
+/* rules of one condition, ordered so that the rules holding at any value
+ * are always a prefix of the table */
+typedef struct RuleTable {
+  Rule *rules;
+  int *limits; /* thresholds, negated for rising conditions */
+  bool *held;  /* rules that fired and were not re-armed yet */
+  int count;
+  int active;  /* length of the prefix that currently holds */
+  bool settle; /* held is not a prefix after a reload, check every rule once */
+} RuleTable;
+
+static RuleTable tables[RULE_TABLES];
+
+/* rendered rule command */
+static char command[TEMPLATE_LENGTH];
+
+/* active fullscreen rules, the alert stays up while any of them holds */
+static int fullscreen_active = 0;
+
+static char *action_names[] = { "notify", "urgent", "command", "fullscreen" };
+
+static char* rule_action_name(int action)
+{
+  if (action < 0)
+    return action_names[-action - 1];
+  return logind_action_name(action);
+}
+
+/* THRESHOLD:ACTION[:ARGUMENT] - 30%, 5m or >95% followed by notify, urgent,
+ * command, fullscreen or a logind action */
+int parse_rule(char *spec, Rule **rules, int count)
+{
+  Rule *rule;
+  char *action;
+  char *end;
+  long threshold;
+
+  *rules = realloc(*rules, sizeof(Rule) * (count + 1));
+  if (*rules == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  rule = &(*rules)[count];
+  *rule = (Rule){ .condition = RULE_LEVEL, .argument = NULL, .template = NULL };
+
+  action = strchr(spec, ':');
+  if (action == NULL)
+    errx(EXIT_FAILURE, "Rule `%s' has no action.", spec);
+  *action++ = '\0';
+  rule->argument = strchr(action, ':');
+  if (rule->argument)
+    *rule->argument++ = '\0';
+
+  if (*spec == '>') {
+    rule->condition = RULE_CHARGED;
+    spec++;
+  }
+  errno = 0;
+  threshold = strtol(spec, &end, 10);
+  if (end == spec)
+    errx(EXIT_FAILURE, "Rule threshold `%s' is not a number.", spec);
+  if (errno == ERANGE || threshold < INT_MIN || threshold > INT_MAX)
+    errx(EXIT_FAILURE, "Rule threshold `%s' is out of range.", spec);
+  rule->threshold = threshold;
+  if (strcmp(end, "m") == 0 && rule->condition == RULE_LEVEL)
+    rule->condition = RULE_MINUTES;
+  else if (strcmp(end, "%") != 0 && *end != '\0')
+    errx(EXIT_FAILURE, "Unknown rule threshold `%s'.", spec);
+
+  if (rule->condition == RULE_MINUTES && (rule->threshold < 1 || rule->threshold > 1440))
+    errx(EXIT_FAILURE, "Rule minutes must be between 1 and 1440.");
+  if (rule->condition != RULE_MINUTES && (rule->threshold < 0 || rule->threshold > 100))
+    errx(EXIT_FAILURE, "Rule level must be between 0 and 100.");
+
+  rule->action = 0;
+  for (int i = 0; i < 4; i++)
+    if (strcmp(action, action_names[i]) == 0)
+      rule->action = -i - 1;
+  if (rule->action == 0 && (rule->action = logind_action(action)) <= ACTION_NONE)
+    errx(EXIT_FAILURE, "Unknown rule action `%s'.", action);
+
+  if ((rule->action == RULE_NOTIFY || rule->action == RULE_URGENT
+        || rule->action == RULE_COMMAND) && (rule->argument == NULL || *rule->argument == '\0'))
+    errx(EXIT_FAILURE, "Rule action `%s' requires an argument.", action);
+  if (rule->argument) {
+    rule->argument = strdup(rule->argument);
+    if (rule->argument == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    rule->template = template_compile(rule->argument, false);
+  }
+
+  return count + 1;
+}
+
+void rules_free(Rule *rules, int count)
+{
+  for (int i = 0; i < count; i++) {
+    free(rules[i].argument);
+    template_free(rules[i].template);
+  }
+  free(rules);
+}
+
+/* least severe first, the rules to reach first: highest level or time,
+ * lowest charge */
+static int compare_limits(const void *a, const void *b)
+{
+  const Rule *x = *(Rule * const *)a;
+  const Rule *y = *(Rule * const *)b;
+  int xl = x->condition == RULE_CHARGED ? -x->threshold : x->threshold;
+  int yl = y->condition == RULE_CHARGED ? -y->threshold : y->threshold;
+
+  return (xl < yl) - (xl > yl);
+}
+
+static bool same_rule(Rule *a, Rule *b)
+{
+  if (a->threshold != b->threshold || a->action != b->action)
+    return false;
+  if (a->argument == NULL || b->argument == NULL)
+    return a->argument == b->argument;
+  return strcmp(a->argument, b->argument) == 0;
+}
+
+/* rules that held before a reload and did not change stay fired, so they
+ * are not run again; new or changed ones are settled on the next check */
+static void carry_over(RuleTable *table, RuleTable *old)
+{
+  for (int i = 0; i < table->count; i++) {
+    for (int j = 0; j < old->count; j++) {
+      if (old->held[j] && same_rule(&table->rules[i], &old->rules[j])) {
+        old->held[j] = false;
+        table->held[i] = true;
+        fullscreen_active += table->rules[i].action == RULE_FULLSCREEN;
+        break;
+      }
+    }
+  }
+  table->settle = true;
+}
+
+/* compile the rules into one sorted decision table per condition */
+void rules_init(Rule *rules, int count)
+{
+  RuleTable old[RULE_TABLES];
+  Rule **sorted;
+  RuleTable *table;
+  int n;
+
+  memcpy(old, tables, sizeof(tables));
+  memset(tables, 0, sizeof(tables));
+  fullscreen_active = 0;
+
+  sorted = malloc(sizeof(Rule *) * (count ? count : 1));
+  if (sorted == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  for (int i = 0; i < count; i++)
+    sorted[i] = &rules[i];
+  qsort(sorted, count, sizeof(Rule *), compare_limits);
+
+  for (int t = 0; t < RULE_TABLES; t++) {
+    table = &tables[t];
+    for (int i = 0; i < count; i++)
+      table->count += sorted[i]->condition == t;
+    if (table->count > 0) {
+      table->rules = malloc(sizeof(Rule) * table->count);
+      table->limits = malloc(sizeof(int) * table->count);
+      table->held = calloc(table->count, sizeof(bool));
+      if (table->rules == NULL || table->limits == NULL || table->held == NULL)
+        err(EXIT_FAILURE, "Memory allocation failed");
+      n = 0;
+      for (int i = 0; i < count; i++) {
+        if (sorted[i]->condition != t)
+          continue;
+        table->rules[n] = *sorted[i];
+        table->limits[n++] = t == RULE_CHARGED ? -sorted[i]->threshold : sorted[i]->threshold;
+      }
+      carry_over(table, &old[t]);
+    }
+
+    free(old[t].rules);
+    free(old[t].limits);
+    free(old[t].held);
+  }
+  free(sorted);
+}
+
+static void run_rule(Rule *rule, BatteryState *battery)
+{
+  double start;
+  bool ok = true;
+  int status;
+
+  switch (rule->action) {
+    case RULE_NOTIFY:
+      notify(rule->template, NOTIFY_URGENCY_NORMAL, *battery);
+      break;
+    case RULE_URGENT:
+      notify(rule->template, NOTIFY_URGENCY_CRITICAL, *battery);
+      break;
+    case RULE_COMMAND:
+      start = metrics_start();
+      template_render(rule->template, command, sizeof(command), NULL, battery);
+      status = system(command);
+      metrics_observe(METRIC_COMMAND, start);
+      ok = status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      break;
+    case RULE_FULLSCREEN:
+      fullscreen_active++;
+      alert_update(battery);
+      start = metrics_start();
+      alert_show();
+      metrics_observe(METRIC_FULLSCREEN, start);
+      break;
+    default:
+      ok = logind_run(rule->action);
+  }
+
+  printf("Rule %s%d%s %s %s at %d%%\n", rule->condition == RULE_CHARGED ? ">" : "",
+      rule->threshold, rule->condition == RULE_MINUTES ? "m" : "%",
+      rule_action_name(rule->action), ok ? "ran" : "failed", battery->level);
+  fflush(stdout);
+}
+
+/* move the boundary of the holding prefix to value, firing the rules that
+ * newly hold and re-arming the ones that stopped holding */
+static void evaluate(RuleTable *table, int value, BatteryState *battery)
+{
+  int low = 0;
+  int high = table->count;
+  int mid;
+
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (table->limits[mid] >= value)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  if (table->settle) {
+    for (int i = 0; i < table->count; i++) {
+      if (i < low && !table->held[i])
+        run_rule(&table->rules[i], battery);
+      else if (i >= low && table->held[i])
+        fullscreen_active -= table->rules[i].action == RULE_FULLSCREEN;
+      table->held[i] = i < low;
+    }
+    table->settle = false;
+  } else {
+    for (int i = low; i < table->active; i++) {
+      fullscreen_active -= table->rules[i].action == RULE_FULLSCREEN;
+      table->held[i] = false;
+    }
+    for (int i = table->active; i < low; i++) {
+      run_rule(&table->rules[i], battery);
+      table->held[i] = true;
+    }
+  }
+  table->active = low;
+}
+
+void rules_evaluate(BatteryState *battery)
+{
+  if (battery->discharging) {
+    evaluate(&tables[RULE_LEVEL], battery->level, battery);
+    /* an unsettled estimate neither fires nor re-arms */
+    if (estimate_stable())
+      evaluate(&tables[RULE_MINUTES], battery->time_to_empty / 60, battery);
+    evaluate(&tables[RULE_CHARGED], 1, battery);
+  } else {
+    evaluate(&tables[RULE_LEVEL], INT_MAX, battery);
+    evaluate(&tables[RULE_MINUTES], INT_MAX, battery);
+    evaluate(&tables[RULE_CHARGED], -battery->level, battery);
+  }
+}
+
+/* the next level rule to be crossed while discharging, -1 if none */
+int rules_next_level()
+{
+  RuleTable *table = &tables[RULE_LEVEL];
+
+  if (table->active >= table->count)
+    return -1;
+  return table->limits[table->active];
+}
+
+bool rules_fullscreen()
+{
+  return fullscreen_active > 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdbool.h>
+#include "battery.h"
+#include "template.h"
+
+/* rule conditions */
+#define RULE_LEVEL 0     /* discharging, level at or below */
+#define RULE_MINUTES 1   /* discharging, minutes left at or below */
+#define RULE_CHARGED 2   /* charging, level at or above */
+#define RULE_TABLES 3
+
+/* rule actions besides the logind ones (ACTION_SUSPEND...) */
+#define RULE_NOTIFY -1
+#define RULE_URGENT -2
+#define RULE_COMMAND -3
+#define RULE_FULLSCREEN -4
+
+/* a threshold and what to do when it is crossed */
+typedef struct Rule {
+  int condition;
+  int threshold;
+  int action;
+  char *argument;
+  Template *template; /* the argument of notify, urgent and command */
+} Rule;
+
+int parse_rule(char *spec, Rule **rules, int count);
+void rules_init(Rule *rules, int count);
+void rules_free(Rule *rules, int count);
+void rules_evaluate(BatteryState *battery);
+int rules_next_level();
+bool rules_fullscreen();
+
+#endif
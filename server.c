@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "battery.h"
+#include "event.h"
+#include "server.h"
+
+typedef struct Client {
+  int fd;
+  bool subscribed;
+  char in[32];
+  size_t in_length;
+  char out[SERVER_MESSAGE_LENGTH];
+  size_t out_length;
+  size_t out_sent;
+  bool pending; /* a newer message waits for the current one to be sent */
+  int drops;
+} Client;
+
+static int listen_fd = -1;
+static struct sockaddr_un address;
+
+static char message[SERVER_MESSAGE_LENGTH] = "";
+static size_t message_length = 0;
+
+static Client **clients = NULL;
+static int client_count = 0;
+
+static int format_state_message(char *buf, size_t size, BatteryState *battery)
+{
+  double rate = 0;
+
+  /* percent per hour, so small jitter in the raw rate does not count as a change */
+  if (battery->energy_full > 0)
+    rate = 360000 * battery->rate / battery->energy_full;
+
+  return snprintf(buf, size, "level=%d state=%s rate=%.1f time=%d\n",
+      battery->level, state_name(battery->state), rate,
+      battery->time_to_empty < 0 ? -1 : battery->time_to_empty / 60);
+}
+
+static void drop_client(Client *client)
+{
+  event_remove(client->fd);
+  close(client->fd);
+  for (int i = 0; i < client_count; i++) {
+    if (clients[i] == client) {
+      clients[i] = clients[--client_count];
+      break;
+    }
+  }
+  free(client);
+}
+
+/* returns false if the client was dropped */
+static bool send_message(Client *client);
+
+static bool flush_client(Client *client)
+{
+  ssize_t sent;
+
+  while (client->out_sent < client->out_length) {
+    sent = send(client->fd, client->out + client->out_sent,
+        client->out_length - client->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      event_modify(client->fd, POLLIN | POLLOUT);
+      return true;
+    }
+    if (sent <= 0) {
+      drop_client(client);
+      return false;
+    }
+    client->out_sent += sent;
+  }
+
+  client->out_length = client->out_sent = 0;
+  event_modify(client->fd, POLLIN);
+  if (client->pending) {
+    client->pending = false;
+    return send_message(client);
+  }
+  if (!client->subscribed) {
+    drop_client(client);
+    return false;
+  }
+  return true;
+}
+
+/* queue the current message, a client still busy with the last one gets
+ * only the newest once done, and is dropped if it keeps falling behind */
+static bool send_message(Client *client)
+{
+  if (client->out_length > 0) {
+    if (++client->drops > SERVER_MAX_DROPS) {
+      drop_client(client);
+      return false;
+    }
+    client->pending = true;
+    return true;
+  }
+
+  client->drops = 0;
+  memcpy(client->out, message, message_length);
+  client->out_length = message_length;
+  client->out_sent = 0;
+  return flush_client(client);
+}
+
+static void handle_command(Client *client, char *command)
+{
+  if (strcmp(command, "subscribe") == 0) {
+    client->subscribed = true;
+    send_message(client);
+  } else if (strcmp(command, "query") == 0) {
+    client->subscribed = false;
+    send_message(client);
+  } else {
+    drop_client(client);
+  }
+}
+
+static void client_event(int fd, short revents, void *data)
+{
+  Client *client = data;
+  ssize_t received;
+  char *end;
+
+  if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    drop_client(client);
+    return;
+  }
+
+  if ((revents & POLLOUT) && !flush_client(client))
+    return;
+
+  if (!(revents & POLLIN))
+    return;
+
+  received = recv(fd, client->in + client->in_length,
+      sizeof(client->in) - client->in_length - 1, MSG_DONTWAIT);
+  if (received <= 0) {
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    drop_client(client);
+    return;
+  }
+  client->in_length += received;
+  client->in[client->in_length] = '\0';
+
+  end = strchr(client->in, '\n');
+  if (end == NULL) {
+    if (client->in_length == sizeof(client->in) - 1)
+      drop_client(client);
+    return;
+  }
+  *end = '\0';
+  client->in_length = 0;
+  handle_command(client, client->in);
+}
+
+static void listen_event(int fd, short revents, void *data)
+{
+  Client *client;
+  int client_fd;
+
+  while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    client = calloc(1, sizeof(Client));
+    clients = realloc(clients, sizeof(Client *) * (client_count + 1));
+    if (client == NULL || clients == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    client->fd = client_fd;
+    clients[client_count++] = client;
+    event_add(client_fd, POLLIN, client_event, client);
+  }
+}
+
+/* false if clients cannot be served, a reload keeps running without it */
+bool server_init()
+{
+  char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+  if (runtime_dir == NULL || runtime_dir[0] == '\0') {
+    warnx("XDG_RUNTIME_DIR is not set");
+    return false;
+  }
+
+  address.sun_family = AF_UNIX;
+  if (snprintf(address.sun_path, sizeof(address.sun_path), "%s/" SERVER_SOCKET, runtime_dir)
+      >= (int)sizeof(address.sun_path)) {
+    warnx("Socket path is too long");
+    return false;
+  }
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    warn("Could not create socket");
+    return false;
+  }
+  unlink(address.sun_path);
+  if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0
+      || listen(listen_fd, SOMAXCONN) < 0) {
+    warn("Could not listen on %s", address.sun_path);
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  event_add(listen_fd, POLLIN, listen_event, NULL);
+  return true;
+}
+
+void server_publish(BatteryState *battery)
+{
+  char buf[SERVER_MESSAGE_LENGTH];
+  int length;
+
+  if (listen_fd < 0)
+    return;
+
+  length = format_state_message(buf, sizeof(buf), battery);
+  if (length >= SERVER_MESSAGE_LENGTH)
+    length = SERVER_MESSAGE_LENGTH - 1;
+  if ((size_t)length == message_length && memcmp(buf, message, length) == 0)
+    return;
+
+  memcpy(message, buf, length);
+  message_length = length;
+
+  /* iterate backwards, dropping a client moves the last one into its slot */
+  for (int i = client_count - 1; i >= 0; i--)
+    if (clients[i]->subscribed)
+      send_message(clients[i]);
+}
+
+void server_uninit()
+{
+  if (listen_fd < 0)
+    return;
+  while (client_count > 0)
+    drop_client(clients[0]);
+  event_remove(listen_fd);
+  close(listen_fd);
+  unlink(address.sun_path);
+  listen_fd = -1;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+#define SERVER_SOCKET "batsignal.sock"
+
+/* longest state message sent to clients */
+#define SERVER_MESSAGE_LENGTH 128
+
+/* messages a subscriber may miss in a row before it is disconnected */
+#define SERVER_MAX_DROPS 8
+
+bool server_init();
+void server_publish(BatteryState *battery);
+void server_uninit();
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "battery.h"
+#include "batsignal_shm.h"
+#include "shm.h"
+
+static struct batsignal_shm *shm = NULL;
+static char *shm_path = NULL;
+
+/* false if the state cannot be shared, a reload keeps running without it */
+bool shm_init()
+{
+  char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  int fd;
+
+  if (runtime_dir == NULL || runtime_dir[0] == '\0') {
+    warnx("XDG_RUNTIME_DIR is not set");
+    return false;
+  }
+
+  shm_path = realloc(shm_path, strlen(runtime_dir) + strlen("/" BATSIGNAL_SHM_FILE) + 1);
+  if (shm_path == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  strcpy(shm_path, runtime_dir);
+  strcat(shm_path, "/" BATSIGNAL_SHM_FILE);
+
+  /* start from a fresh file, readers may still map an old one */
+  unlink(shm_path);
+  fd = open(shm_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    warn("Could not create %s", shm_path);
+    return false;
+  }
+  if (ftruncate(fd, sizeof(struct batsignal_shm)) < 0) {
+    warn("Could not size %s", shm_path);
+    close(fd);
+    unlink(shm_path);
+    return false;
+  }
+  shm = mmap(NULL, sizeof(struct batsignal_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) {
+    warn("Could not map %s", shm_path);
+    unlink(shm_path);
+    shm = NULL;
+    return false;
+  }
+
+  shm->version = BATSIGNAL_SHM_VERSION;
+  shm->pid = getpid();
+  __atomic_store_n(&shm->sequence, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  shm->magic = BATSIGNAL_SHM_MAGIC;
+  return true;
+}
+
+void shm_publish(BatteryState *battery)
+{
+  struct batsignal_state *state;
+  struct batsignal_battery *each;
+  uint32_t sequence;
+
+  if (shm == NULL)
+    return;
+
+  sequence = __atomic_load_n(&shm->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&shm->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  state = &shm->state;
+  state->updated = time(NULL);
+  state->energy_now = battery->energy_now;
+  state->energy_full = battery->energy_full;
+  state->rate = battery->rate;
+  state->time_to_empty = battery->time_to_empty;
+  state->level = battery->level;
+  state->state = battery->state;
+  state->discharging = battery->discharging;
+  state->battery_count = battery->count < BATSIGNAL_SHM_BATTERIES ? battery->count : BATSIGNAL_SHM_BATTERIES;
+
+  for (int i = 0; i < state->battery_count; i++) {
+    each = &state->batteries[i];
+    strncpy(each->name, battery->names[i], BATSIGNAL_SHM_NAME_LENGTH - 1);
+    each->energy_now = battery->energies_now[i];
+    each->energy_full = battery->energies_full[i];
+    each->level = battery_level(battery, i);
+    each->status = battery->statuses[i];
+  }
+
+  __atomic_store_n(&shm->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void shm_uninit()
+{
+  if (shm == NULL)
+    return;
+  munmap(shm, sizeof(struct batsignal_shm));
+  unlink(shm_path);
+  shm = NULL;
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+bool shm_init();
+void shm_publish(BatteryState *battery);
+void shm_uninit();
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "battery.h"
+#include "template.h"
+
+/* placeholder names, indexed by field */
+static const char *field_names[] = {
+  NULL, "message", "level", "state", "minutes", "time", "rate", "timestamp"
+};
+
+/* where a render writes to, always kept terminated */
+typedef struct Output {
+  char *buffer;
+  size_t size;
+  size_t length;
+} Output;
+
+static void add(Template *template, int field, const char *text, size_t length, int battery)
+{
+  Segment *last = template->count ? &template->segments[template->count - 1] : NULL;
+
+  if (field == FIELD_TEXT && length == 0)
+    return;
+  if (field == FIELD_TEXT && last && last->field == FIELD_TEXT && last->text + last->length == text) {
+    last->length += length;
+    return;
+  }
+
+  template->segments = realloc(template->segments, sizeof(Segment) * (template->count + 1));
+  if (template->segments == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  template->segments[template->count++] = (Segment){
+    .field = field, .text = text, .length = length, .battery = battery
+  };
+}
+
+/* a template for one battery knows it by index: {name}, {level} and
+ * {status} are about that battery */
+static int lookup_battery(const char *name, size_t length)
+{
+  if (length == 4 && strncmp(name, "name", 4) == 0)
+    return FIELD_BATTERY_NAME;
+  if (length == 5 && strncmp(name, "level", 5) == 0)
+    return FIELD_BATTERY_LEVEL;
+  if (length == 6 && strncmp(name, "status", 6) == 0)
+    return FIELD_BATTERY_STATUS;
+  return -1;
+}
+
+/* the field named between braces, -1 if it is not a placeholder */
+static int lookup(const char *name, size_t length, const char **battery, size_t *battery_length)
+{
+  const char *colon = memchr(name, ':', length);
+
+  if (colon) {
+    *battery = colon + 1;
+    *battery_length = name + length - *battery;
+    if (*battery_length == 0)
+      return -1;
+    if (colon - name == 5 && strncmp(name, "level", 5) == 0)
+      return FIELD_BATTERY_LEVEL;
+    if (colon - name == 6 && strncmp(name, "status", 6) == 0)
+      return FIELD_BATTERY_STATUS;
+    return -1;
+  }
+
+  for (int i = FIELD_MESSAGE; i <= FIELD_TIMESTAMP; i++)
+    if (strlen(field_names[i]) == length && strncmp(name, field_names[i], length) == 0)
+      return i;
+  return -1;
+}
+
+/* split format into literal text and placeholders; anything in braces that
+ * is not a placeholder stays literal, so shell commands keep working, and
+ * with printf_compat %s is the message then the level, as -M used to be */
+static Template* compile(const char *format, bool printf_compat, int index)
+{
+  Template *template = calloc(1, sizeof(Template));
+  const char *start;
+  const char *p;
+  const char *close;
+  const char *battery = NULL;
+  size_t battery_length = 0;
+  int printf_args = 0;
+  int field;
+
+  if (template == NULL || (template->source = strdup(format)) == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  start = p = template->source;
+
+  while (*p != '\0') {
+    if (printf_compat && p[0] == '%' && (p[1] == 's' || p[1] == '%')) {
+      add(template, FIELD_TEXT, start, p - start, -1);
+      if (p[1] == '%')
+        add(template, FIELD_TEXT, p + 1, 1, -1);
+      else if (printf_args < 2)
+        add(template, printf_args++ ? FIELD_LEVEL : FIELD_MESSAGE, NULL, 0, -1);
+      start = p += 2;
+      continue;
+    }
+
+    if (*p == '{' && (close = strchr(p, '}')) && index >= 0
+        && (field = lookup_battery(p + 1, close - p - 1)) >= 0) {
+      add(template, FIELD_TEXT, start, p - start, -1);
+      add(template, field, NULL, 0, index);
+      start = p = close + 1;
+      continue;
+    }
+
+    if (*p == '{' && (close = strchr(p, '}')) && index < 0
+        && (field = lookup(p + 1, close - p - 1, &battery, &battery_length)) >= 0) {
+      add(template, FIELD_TEXT, start, p - start, -1);
+      if (field == FIELD_BATTERY_LEVEL || field == FIELD_BATTERY_STATUS)
+        add(template, field, battery, battery_length, -1);
+      else
+        add(template, field, NULL, 0, -1);
+      start = p = close + 1;
+      continue;
+    }
+    p++;
+  }
+  add(template, FIELD_TEXT, start, p - start, -1);
+
+  return template;
+}
+
+Template* template_compile(const char *format, bool printf_compat)
+{
+  return compile(format, printf_compat, -1);
+}
+
+/* for messages about a battery picked at run time, which is given by
+ * index and never pasted into the format */
+Template* template_battery(const char *format, int battery)
+{
+  return compile(format, false, battery);
+}
+
+bool template_empty(Template *template)
+{
+  return template == NULL || template->count == 0;
+}
+
+static void append(Output *out, const char *text, size_t length)
+{
+  if (length > out->size - 1 - out->length)
+    length = out->size - 1 - out->length;
+  memcpy(out->buffer + out->length, text, length);
+  out->length += length;
+  out->buffer[out->length] = '\0';
+}
+
+static void append_string(Output *out, const char *text)
+{
+  append(out, text, strlen(text));
+}
+
+/* digits of a non-negative value, at least width of them */
+static void append_number(Output *out, long value, int width)
+{
+  char digits[24];
+  int i = sizeof(digits);
+
+  if (value < 0) {
+    append(out, "-", 1);
+    value = -value;
+  }
+  do {
+    digits[--i] = '0' + value % 10;
+    value /= 10;
+  } while ((value > 0 || (int)sizeof(digits) - i < width) && i > 0);
+  append(out, digits + i, sizeof(digits) - i);
+}
+
+/* resolved once, the battery list does not change while running */
+static int battery_index(Segment *segment, BatteryState *battery)
+{
+  if (segment->battery >= battery->count)
+    return -2;
+  if (segment->battery == -1) {
+    segment->battery = -2;
+    for (int i = 0; i < battery->count; i++)
+      if (strlen(battery->names[i]) == segment->length
+          && strncmp(battery->names[i], segment->text, segment->length) == 0)
+        segment->battery = i;
+  }
+  return segment->battery;
+}
+
+static void render_field(Output *out, Segment *segment, const char *message, BatteryState *battery)
+{
+  struct tm tm;
+  time_t now;
+  long tenths;
+  int index;
+
+  switch (segment->field) {
+    case FIELD_TEXT:
+      append(out, segment->text, segment->length);
+      break;
+    case FIELD_MESSAGE:
+      if (message)
+        append_string(out, message);
+      break;
+    case FIELD_LEVEL:
+      append_number(out, battery->level, 1);
+      break;
+    case FIELD_STATE:
+      append_string(out, state_name(battery->state));
+      break;
+    case FIELD_MINUTES:
+      if (battery->time_to_empty < 0)
+        append(out, "?", 1);
+      else
+        append_number(out, battery->time_to_empty / 60, 1);
+      break;
+    case FIELD_TIME:
+      if (battery->time_to_empty < 0) {
+        append(out, "?", 1);
+        break;
+      }
+      append_number(out, battery->time_to_empty / 3600, 1);
+      append(out, ":", 1);
+      append_number(out, battery->time_to_empty / 60 % 60, 2);
+      break;
+    case FIELD_RATE:
+      /* percent per hour, the same unit as the JSON output */
+      tenths = battery->energy_full ? lround(3600000 * battery->rate / battery->energy_full) : 0;
+      append_number(out, tenths / 10, 1);
+      append(out, ".", 1);
+      append_number(out, tenths % 10, 1);
+      break;
+    case FIELD_TIMESTAMP:
+      now = time(NULL);
+      localtime_r(&now, &tm);
+      append_number(out, tm.tm_hour, 2);
+      append(out, ":", 1);
+      append_number(out, tm.tm_min, 2);
+      break;
+    case FIELD_BATTERY_LEVEL:
+      if ((index = battery_index(segment, battery)) < 0)
+        append(out, "?", 1);
+      else
+        append_number(out, battery_level(battery, index), 1);
+      break;
+    case FIELD_BATTERY_STATUS:
+      if ((index = battery_index(segment, battery)) < 0)
+        append(out, "?", 1);
+      else
+        append_string(out, status_name(battery->statuses[index]));
+      break;
+    case FIELD_BATTERY_NAME:
+      if ((index = battery_index(segment, battery)) < 0)
+        append(out, "?", 1);
+      else
+        append_string(out, battery->names[index]);
+      break;
+  }
+}
+
+/* render into a caller owned buffer, returns the length written */
+size_t template_render(Template *template, char *buffer, size_t size,
+    const char *message, BatteryState *battery)
+{
+  Output out = { .buffer = buffer, .size = size, .length = 0 };
+
+  buffer[0] = '\0';
+  if (template == NULL)
+    return 0;
+  for (int i = 0; i < template->count; i++)
+    render_field(&out, &template->segments[i], message, battery);
+  return out.length;
+}
+
+void template_free(Template *template)
+{
+  if (template == NULL)
+    return;
+  free(template->source);
+  free(template->segments);
+  free(template);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "battery.h"
+
+/* rendered messages and commands are cut at this length */
+#define TEMPLATE_LENGTH 1024
+
+/* template segments */
+#define FIELD_TEXT 0
+#define FIELD_MESSAGE 1
+#define FIELD_LEVEL 2
+#define FIELD_STATE 3
+#define FIELD_MINUTES 4
+#define FIELD_TIME 5
+#define FIELD_RATE 6
+#define FIELD_TIMESTAMP 7
+#define FIELD_BATTERY_LEVEL 8
+#define FIELD_BATTERY_STATUS 9
+#define FIELD_BATTERY_NAME 10
+
+/* a literal run of text or a typed placeholder */
+typedef struct Segment {
+  int field;
+  const char *text; /* literal text, or the battery name */
+  size_t length;
+  int battery;      /* index of the named battery, -1 until resolved */
+} Segment;
+
+/* a message parsed once into segments */
+typedef struct Template {
+  char *source;     /* a copy of the format, the segments point into it */
+  Segment *segments;
+  int count;
+} Template;
+
+Template* template_compile(const char *format, bool printf_compat);
+Template* template_battery(const char *format, int battery);
+size_t template_render(Template *template, char *buffer, size_t size,
+    const char *message, BatteryState *battery);
+void template_free(Template *template);
+bool template_empty(Template *template);
+
+#endif
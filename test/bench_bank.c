@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+/* times bank_reduce over growing banks of made up batteries, run with
+ * make bench */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../bank.h"
+#include "../notify.h"
+#include "../template.h"
+
+#define REPEATS 2000
+
+/* one battery in this many is drained far below the rest */
+#define OUTLIER_EVERY 10
+
+/* only the reduction is timed, nothing here alerts */
+void notify(Template *msg, NotifyUrgency urgency, BatteryState battery) {}
+Template* template_battery(const char *format, int battery) { return NULL; }
+void template_free(Template *template) {}
+
+static double now_seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main()
+{
+  BatteryState battery = { 0 };
+  BankStats stats;
+  double start;
+  int expected;
+
+  for (int count = 1000; count <= 64000; count *= 4) {
+    battery.count = count;
+    battery.energies_now = malloc(sizeof(int) * count);
+    battery.energies_full = malloc(sizeof(int) * count);
+    if (battery.energies_now == NULL || battery.energies_full == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+
+    /* most batteries sit at 59-61%, within the 5 point spread of the bank
+     * level around 57%, every OUTLIER_EVERY-th one is at 30% */
+    expected = 0;
+    for (int i = 0; i < count; i++) {
+      battery.energies_full[i] = 50000000 + i % 97 * 10000;
+      if (i % OUTLIER_EVERY == 0) {
+        battery.energies_now[i] = battery.energies_full[i] / 100 * 30;
+        expected++;
+      } else {
+        battery.energies_now[i] = battery.energies_full[i] / 100 * (60 + i % 3 - 1);
+      }
+    }
+
+    bank_init(5, count);
+    start = now_seconds();
+    for (int i = 0; i < REPEATS; i++)
+      bank_reduce(&battery, &stats);
+    printf("%6d batteries: %8.2f us per reduction (level %d, outliers %d of %d expected)\n",
+        count, (now_seconds() - start) / REPEATS * 1e6, stats.level, stats.outliers, expected);
+
+    free(battery.energies_now);
+    free(battery.energies_full);
+  }
+  bank_init(0, 0);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+/* stands in for logind on a private bus for make check: every Can* method
+ * answers yes and every action is printed instead of taken */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "../logind.h"
+
+static const char introspection_xml[] =
+  "<node>"
+  "  <interface name='" LOGIND_MANAGER_INTERFACE "'>"
+  "    <method name='CanSuspend'><arg type='s' direction='out'/></method>"
+  "    <method name='CanHibernate'><arg type='s' direction='out'/></method>"
+  "    <method name='CanHybridSleep'><arg type='s' direction='out'/></method>"
+  "    <method name='CanPowerOff'><arg type='s' direction='out'/></method>"
+  "    <method name='Suspend'><arg type='b' direction='in'/></method>"
+  "    <method name='Hibernate'><arg type='b' direction='in'/></method>"
+  "    <method name='HybridSleep'><arg type='b' direction='in'/></method>"
+  "    <method name='PowerOff'><arg type='b' direction='in'/></method>"
+  "  </interface>"
+  "</node>";
+
+static void method_call(GDBusConnection *connection, const gchar *sender,
+    const gchar *path, const gchar *interface, const gchar *method,
+    GVariant *parameters, GDBusMethodInvocation *invocation, gpointer data)
+{
+  if (strncmp(method, "Can", 3) == 0) {
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(s)", "yes"));
+    return;
+  }
+  printf("%s\n", method);
+  fflush(stdout);
+  g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static const GDBusInterfaceVTable vtable = { method_call, NULL, NULL, { 0 } };
+
+static void name_lost(GDBusConnection *connection, const gchar *name, gpointer data)
+{
+  fprintf(stderr, "fake_logind: could not own %s\n", name);
+  exit(EXIT_FAILURE);
+}
+
+/* the bus is the system bus from DBUS_SYSTEM_BUS_ADDRESS */
+int main()
+{
+  GDBusNodeInfo *node;
+  GDBusConnection *bus;
+  GError *error = NULL;
+
+  node = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+  bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+  if (node == NULL || bus == NULL) {
+    fprintf(stderr, "fake_logind: %s\n", error ? error->message : "bad introspection data");
+    return EXIT_FAILURE;
+  }
+  if (g_dbus_connection_register_object(bus, LOGIND_OBJECT_PATH, node->interfaces[0],
+        &vtable, NULL, NULL, &error) == 0) {
+    fprintf(stderr, "fake_logind: %s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  g_bus_own_name_on_connection(bus, LOGIND_BUS_NAME, G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE,
+      NULL, name_lost, NULL, NULL);
+
+  g_main_loop_run(g_main_loop_new(NULL, FALSE));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+#!/bin/sh
+#
+# Smoke test of the danger actions, hibernation preparation, cgroup freezer,
+# power saving and D-Bus service against a fake sysfs tree. Actions go to a
+# systemctl stand-in, or with D-Bus to a logind stand-in on a private bus.
+# Run with make check.
+
+BATSIGNAL=${BATSIGNAL:-./batsignal}
+DBUS=${DBUS:-1}
+
+# with D-Bus the whole test runs again inside a private session bus, which
+# stands in for the system bus too
+if [ "$DBUS" = 1 ] && [ -z "$SMOKE_BUS" ]; then
+  if ! command -v dbus-run-session >/dev/null || ! command -v dbus-send >/dev/null; then
+    echo "skip: the D-Bus paths need dbus-run-session and dbus-send"
+    exit 0
+  fi
+  SMOKE_BUS=1 exec dbus-run-session -- "$0" "$@"
+fi
+
+dir=$(mktemp -d)
+root=$dir/root
+pids=""
+failed=0
+
+cleanup() {
+  for pid in $pids; do
+    kill "$pid" 2>/dev/null
+  done
+  rm -rf "$dir"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+pass() {
+  echo "ok: $1"
+}
+
+fail() {
+  echo "FAIL: $1"
+  failed=1
+}
+
+# wait up to 5 seconds for a file to contain a line matching a pattern
+wait_for() {
+  i=0
+  while [ $i -lt 50 ]; do
+    grep -q "$2" "$1" 2>/dev/null && return 0
+    sleep 0.1
+    i=$((i + 1))
+  done
+  return 1
+}
+
+expect() {
+  if wait_for "$2" "^$3\$"; then
+    pass "$1"
+  else
+    fail "$1: found '$(cat "$2" 2>/dev/null)', expected '$3'"
+  fi
+}
+
+# one battery at 1%, below every default level
+bat=$root/sys/class/power_supply/BAT0
+mkdir -p "$bat"
+echo Battery > "$bat/type"
+echo Discharging > "$bat/status"
+echo 10000 > "$bat/energy_now"
+echo 1000000 > "$bat/energy_full"
+echo 5000000 > "$bat/power_now"
+
+cgroup=$root/sys/fs/cgroup/app.slice
+mkdir -p "$cgroup"
+echo 0 > "$cgroup/cgroup.freeze"
+
+backlight=$root/sys/class/backlight/panel
+cpu=$root/sys/devices/system/cpu
+mkdir -p "$backlight" "$root/sys/firmware/acpi" "$cpu/cpufreq/policy0" "$cpu/intel_pstate"
+echo 100 > "$backlight/max_brightness"
+echo 80 > "$backlight/brightness"
+echo balanced > "$root/sys/firmware/acpi/platform_profile"
+echo balance_performance > "$cpu/cpufreq/policy0/energy_performance_preference"
+echo 0 > "$cpu/intel_pstate/no_turbo"
+
+vm=$root/proc/sys/vm
+mkdir -p "$vm"
+echo 0 > "$vm/drop_caches"
+echo 0 > "$vm/compact_memory"
+
+: > "$dir/config"
+: > "$dir/actions"
+options=""
+
+if [ "$DBUS" = 1 ]; then
+  DBUS_SYSTEM_BUS_ADDRESS=$DBUS_SESSION_BUS_ADDRESS
+  export DBUS_SYSTEM_BUS_ADDRESS
+
+  ./test/fake_logind > "$dir/actions" &
+  pids="$pids $!"
+  i=0
+  until dbus-send --session --print-reply --dest=org.freedesktop.DBus / \
+      org.freedesktop.DBus.NameHasOwner string:org.freedesktop.login1 2>/dev/null | grep -q true; do
+    i=$((i + 1))
+    [ $i -lt 50 ] || { echo "FAIL: logind stand-in did not start"; exit 1; }
+    sleep 0.1
+  done
+  suspend=Suspend
+  options=-B
+else
+  mkdir "$dir/bin"
+  printf '#!/bin/sh\necho "$2" >> "%s"\n' "$dir/actions" > "$dir/bin/systemctl"
+  chmod +x "$dir/bin/systemctl"
+  PATH=$dir/bin:$PATH
+  suspend=suspend
+fi
+
+BATSIGNAL_CONFIG=$dir/config XDG_RUNTIME_DIR=$dir "$BATSIGNAL" -R "$root" -N -m 1 -H \
+  -A suspend -Z app.slice -S level=critical,profile=low-power,epp=power,backlight=30,noturbo \
+  $options > "$dir/out" 2>&1 &
+daemon=$!
+pids="$pids $daemon"
+
+expect "danger action requested" "$dir/actions" "$suspend"
+expect "cgroup frozen" "$cgroup/cgroup.freeze" 1
+expect "platform profile set" "$root/sys/firmware/acpi/platform_profile" low-power
+expect "energy preference set" "$cpu/cpufreq/policy0/energy_performance_preference" power
+expect "backlight capped" "$backlight/brightness" 30
+expect "turbo disabled" "$cpu/intel_pstate/no_turbo" 1
+expect "caches dropped" "$vm/drop_caches" 1
+expect "memory compacted" "$vm/compact_memory" 1
+
+# the hibernation image is shrunk before the first danger step is requested
+prepared=$(grep -n "^Compacted memory" "$dir/out" | cut -d: -f1)
+requested=$(grep -n "^Danger step 1/" "$dir/out" | cut -d: -f1)
+if [ -n "$prepared" ] && [ -n "$requested" ] && [ "$prepared" -lt "$requested" ]; then
+  pass "prepared before the danger step"
+else
+  fail "prepared before the danger step"
+fi
+
+if [ "$DBUS" = 1 ]; then
+  dbus-send --session --print-reply --dest=org.batsignal /org/batsignal \
+    org.freedesktop.DBus.Properties.Get string:org.batsignal.Battery string:Level > "$dir/level" 2>&1
+  expect "Level published on D-Bus" "$dir/level" ".*int32 1"
+fi
+
+# everything changed is put back on exit
+kill "$daemon" 2>/dev/null
+wait "$daemon" 2>/dev/null
+
+expect "cgroup thawed" "$cgroup/cgroup.freeze" 0
+expect "platform profile restored" "$root/sys/firmware/acpi/platform_profile" balanced
+expect "energy preference restored" "$cpu/cpufreq/policy0/energy_performance_preference" balance_performance
+expect "backlight restored" "$backlight/brightness" 80
+expect "turbo restored" "$cpu/intel_pstate/no_turbo" 0
+
+if [ $failed -ne 0 ]; then
+  echo "batsignal output:"
+  cat "$dir/out"
+fi
+exit $failed
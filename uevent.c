@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "battery.h"
+#include "event.h"
+#include "uevent.h"
+
+static int uevent_fd = -1;
+
+/* open addressing table from battery name to index, so that an event is
+ * matched in constant time however many batteries there are */
+static char **names = NULL;
+static int *slots = NULL;
+static uint32_t slot_mask = 0;
+
+static uint32_t hash(const char *name)
+{
+  uint32_t h = 2166136261u;
+
+  while (*name != '\0')
+    h = (h ^ (unsigned char)*name++) * 16777619u;
+  return h;
+}
+
+static void build_table(BatteryState *battery)
+{
+  uint32_t size = 8;
+  uint32_t slot;
+
+  while (size < (uint32_t)battery->count * 2)
+    size *= 2;
+  free(slots);
+  slots = malloc(size * sizeof(int));
+  if (slots == NULL)
+    err(EXIT_FAILURE, "Memory allocation failed");
+  for (uint32_t i = 0; i < size; i++)
+    slots[i] = -1;
+  slot_mask = size - 1;
+  names = battery->names;
+
+  for (int i = 0; i < battery->count; i++) {
+    slot = hash(names[i]) & slot_mask;
+    while (slots[slot] >= 0)
+      slot = (slot + 1) & slot_mask;
+    slots[slot] = i;
+  }
+}
+
+static int lookup(const char *name)
+{
+  for (uint32_t slot = hash(name) & slot_mask; slots[slot] >= 0; slot = (slot + 1) & slot_mask)
+    if (strcmp(names[slots[slot]], name) == 0)
+      return slots[slot];
+  return -1;
+}
+
+/* the monitored battery a uevent is about, -1 for anything else */
+static int battery_index(char *message, ssize_t length)
+{
+  bool power_supply = false;
+  char *name = NULL;
+
+  /* ACTION@DEVPATH followed by KEY=VALUE strings */
+  for (char *p = message; p < message + length; p += strlen(p) + 1) {
+    if (strcmp(p, "SUBSYSTEM=power_supply") == 0)
+      power_supply = true;
+    else if (strncmp(p, "POWER_SUPPLY_NAME=", 18) == 0)
+      name = p + 18;
+  }
+  if (!power_supply || name == NULL)
+    return -1;
+  return lookup(name);
+}
+
+static void uevent_event(int fd, short revents, void *data)
+{
+  char buffer[UEVENT_BUFFER_LENGTH + 1];
+  struct sockaddr_nl sender;
+  struct iovec iov = { .iov_base = buffer, .iov_len = UEVENT_BUFFER_LENGTH };
+  struct msghdr msg = { .msg_name = &sender, .msg_namelen = sizeof(sender), .msg_iov = &iov, .msg_iovlen = 1 };
+  bool changed = false;
+  ssize_t length;
+  int index;
+
+  while ((length = recvmsg(fd, &msg, 0)) > 0) {
+    /* only the kernel, not other processes, may announce changes */
+    if (sender.nl_pid != 0)
+      continue;
+    buffer[length] = '\0';
+    index = battery_index(buffer, length);
+    if (index >= 0) {
+      battery_changed(index);
+      changed = true;
+    }
+  }
+
+  /* checks go through SIGUSR1, a burst of events leaves a single one */
+  if (changed)
+    kill(getpid(), SIGUSR1);
+}
+
+void uevent_init(BatteryState *battery)
+{
+  struct sockaddr_nl address = {
+    .nl_family = AF_NETLINK,
+    .nl_groups = UEVENT_KERNEL_GROUP
+  };
+
+  if (uevent_fd >= 0)
+    return;
+
+  uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (uevent_fd < 0 || bind(uevent_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    warn("Could not listen for uevents");
+    if (uevent_fd >= 0)
+      close(uevent_fd);
+    uevent_fd = -1;
+    return;
+  }
+
+  build_table(battery);
+  track_battery_changes(battery);
+  event_add(uevent_fd, POLLIN, uevent_event, NULL);
+}
+
+void uevent_uninit()
+{
+  if (uevent_fd < 0)
+    return;
+  event_remove(uevent_fd);
+  close(uevent_fd);
+  uevent_fd = -1;
+}
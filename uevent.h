@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef UEVENT_H
+#define UEVENT_H
+
+#include "battery.h"
+
+/* kernel uevent multicast group */
+#define UEVENT_KERNEL_GROUP 1
+
+/* largest uevent message read */
+#define UEVENT_BUFFER_LENGTH 8192
+
+/* seconds between full checks when polling is disabled */
+#define UEVENT_VERIFY_INTERVAL 600
+
+void uevent_init(BatteryState *battery);
+void uevent_uninit();
+
+#endif